@@ -64,6 +64,9 @@ class ProtocolParser {
           if (argType === 'object') {
             const proxyTypeName = arg.$.hasOwnProperty('interface') ? `${upperCamelCase(arg.$['interface'])}Proxy` : 'Proxy'
             argTsType = ProtocolArguments[argType](argName, optional, proxyTypeName).jsType
+          } else if (argType === 'array') {
+            // arrays are marshalled from typed array views
+            argTsType = optional ? ': ArrayBufferView|undefined' : ': ArrayBufferView'
           } else {
             argTsType = ProtocolArguments[argType](argName, optional).jsType
           }
@@ -24,8 +24,8 @@ SOFTWARE.
 
 'use strict'
 
-import { Connection, WebFD } from 'westfield-runtime-common'
-import { Display, DisplayImpl, Proxy, WebFS } from './westfield-runtime-client'
+import { Connection, SharedRing, SharedRingFrame, WebFD } from 'westfield-runtime-common'
+import { Display, DisplayImpl, packDamagedPixels, Proxy, WebFS } from './westfield-runtime-client'
 import { WlSurfaceProxy } from './protocol'
 
 const webFS = WebFS.create(_uuidv4())
@@ -41,39 +41,77 @@ function _uuidv4(): string {
 
 function _setupMessageHandling(display: Display, connection: Connection, webFS: WebFS) {
   const _flushQueue: { buffer: ArrayBuffer, fds: Array<WebFD> }[][] = []
+  // set once the compositor switches us over to shared memory rings
+  let _rings: { in: SharedRing, out: SharedRing } | undefined
+  // fds that arrived over the side channel but whose ring frame was not yet processed
+  let _ringFds: WebFD[] = []
+
+  function toWebFDs(meta: Transferable[]): WebFD[] {
+    return meta.map(transferable => {
+      if (transferable instanceof ArrayBuffer) {
+        return webFS.fromArrayBuffer(transferable)
+      } else if (transferable instanceof ImageBitmap) {
+        return webFS.fromImageBitmap(transferable)
+      } else if (transferable instanceof OffscreenCanvas) {
+        return webFS.fromOffscreenCanvas(transferable)
+      }// else if (transferable instanceof MessagePort) {
+      // }
+      else {
+        throw new Error(`COMPOSITOR BUG? Unsupported transferable received from compositor: ${transferable}.`)
+      }
+    })
+  }
+
+  function receive(buffer: Uint32Array, fds: WebFD[]) {
+    try {
+      connection.message({ buffer, fds })
+    } catch (e) {
+      if (display.errorHandler && typeof display.errorHandler === 'function') {
+        display.errorHandler(e)
+      } else {
+        console.error('\tname: ' + e.name + ' message: ' + e.message + ' text: ' + e.text)
+        console.error('error object stack: ')
+        console.error(e.stack)
+      }
+    }
+  }
+
+  function receiveFromRing(ring: SharedRing) {
+    // a frame is only processed once all of its fds have arrived over the side channel
+    let fdCount = ring.peekFdCount()
+    while (fdCount !== undefined && fdCount <= _ringFds.length && !connection.closed) {
+      const frame = ring.read() as SharedRingFrame
+      receive(frame.buffer, _ringFds.slice(0, fdCount))
+      _ringFds = _ringFds.slice(fdCount)
+      fdCount = ring.peekFdCount()
+    }
+  }
+
+  async function pollRing(ring: SharedRing) {
+    while (!connection.closed) {
+      receiveFromRing(ring)
+      await ring.waitReadableAsync()
+    }
+  }
 
   onmessage = (event: MessageEvent) => {
     if (connection.closed) {
       return
     }
 
-    const webWorkerMessage = event.data as { protocolMessage: ArrayBuffer, meta: Transferable[] }
-    if (webWorkerMessage.protocolMessage instanceof ArrayBuffer) {
+    const webWorkerMessage = event.data as { protocolMessage?: ArrayBuffer, meta?: Transferable[], rings?: { serverToClient: SharedArrayBuffer, clientToServer: SharedArrayBuffer } }
+    if (webWorkerMessage.protocolMessage instanceof ArrayBuffer && webWorkerMessage.meta) {
       const buffer = new Uint32Array(/** @type {ArrayBuffer} */webWorkerMessage.protocolMessage)
-      const fds = webWorkerMessage.meta.map(transferable => {
-        if (transferable instanceof ArrayBuffer) {
-          return webFS.fromArrayBuffer(transferable)
-        } else if (transferable instanceof ImageBitmap) {
-          return webFS.fromImageBitmap(transferable)
-        } else if (transferable instanceof OffscreenCanvas) {
-          return webFS.fromOffscreenCanvas(transferable)
-        }// else if (transferable instanceof MessagePort) {
-        // }
-        else {
-          throw new Error(`COMPOSITOR BUG? Unsupported transferable received from compositor: ${transferable}.`)
-        }
-      })
-      try {
-        connection.message({ buffer, fds })
-      } catch (e) {
-        if (display.errorHandler && typeof display.errorHandler === 'function') {
-          display.errorHandler(e)
-        } else {
-          console.error('\tname: ' + e.name + ' message: ' + e.message + ' text: ' + e.text)
-          console.error('error object stack: ')
-          console.error(e.stack)
-        }
+      receive(buffer, toWebFDs(webWorkerMessage.meta))
+    } else if (_rings && webWorkerMessage.meta) {
+      _ringFds = [..._ringFds, ...toWebFDs(webWorkerMessage.meta)]
+      receiveFromRing(_rings.in)
+    } else if (_rings === undefined && webWorkerMessage.rings) {
+      _rings = {
+        in: new SharedRing(webWorkerMessage.rings.serverToClient),
+        out: new SharedRing(webWorkerMessage.rings.clientToServer)
       }
+      pollRing(_rings.in)
     } else {
       console.error(`[web-worker-client] server send an illegal message.`)
       connection.close()
@@ -90,24 +128,40 @@ function _setupMessageHandling(display: Display, connection: Connection, webFS:
     while (_flushQueue.length) {
       const sendWireMessages = _flushQueue[0]
 
-      // convert to single arrayBuffer so it can be send over a data channel using zero copy semantics.
       const messagesSize = sendWireMessages.reduce((previousValue, currentValue) => previousValue + currentValue.buffer.byteLength, 0)
-
-      const sendBuffer = new Uint32Array(new ArrayBuffer(messagesSize))
-      let offset = 0
-      const meta: Transferable[] = []
+      const webFds: WebFD[] = []
       for (const wireMessage of sendWireMessages) {
-        for (const webFd of wireMessage.fds) {
-          const transferable = await webFd.getTransferable()
-          meta.push(transferable)
-        }
-        const message = new Uint32Array(wireMessage.buffer)
-        sendBuffer.set(message, offset)
-        offset += message.length
+        webFds.push(...wireMessage.fds)
       }
+      // resolve all fds of this flush in one go
+      const meta = await WebFD.getTransferables(webFds)
 
-      self.postMessage({ protocolMessage: sendBuffer.buffer, meta }, [sendBuffer.buffer, ...meta])
+      if (_rings && messagesSize <= _rings.out.maxFrameByteLength) {
+        // messages are written straight into shared memory, only fds still go over the side channel
+        while (!_rings.out.write(sendWireMessages, meta.length)) {
+          await _rings.out.waitWritableAsync(messagesSize)
+        }
+        if (meta.length) {
+          self.postMessage({ meta }, meta)
+        }
+      } else {
+        if (_rings) {
+          // too big for the ring, let the compositor read everything that was written before so the order is kept
+          await _rings.out.waitWritableAsync(_rings.out.maxFrameByteLength)
+        }
+        // convert to single arrayBuffer so it can be send over a data channel using zero copy semantics.
+        const sendBuffer = new Uint32Array(new ArrayBuffer(messagesSize))
+        let offset = 0
+        for (const wireMessage of sendWireMessages) {
+          const message = new Uint32Array(wireMessage.buffer)
+          sendBuffer.set(message, offset)
+          offset += message.length
+        }
+        self.postMessage({ protocolMessage: sendBuffer.buffer, meta }, [sendBuffer.buffer, ...meta])
+      }
       _flushQueue.shift()
+      // posting transfers ownership right away, there is nothing left in flight on our side
+      connection.releaseBytesInFlight(messagesSize)
     }
   }
 }
@@ -133,6 +187,7 @@ export {
   display,
   Display,
   frame,
+  packDamagedPixels,
   Proxy
 }
 
@@ -176,6 +176,9 @@ export interface Display {
 }
 
 export class DisplayImpl implements Display {
+  /**
+   * Free list of ids acknowledged by the compositor, used as a stack so taking and returning an id is O(1).
+   */
   private _recycledIds: number[] = []
   private readonly _connection: Connection
   private _displayProxy: WlDisplayProxy
@@ -231,7 +234,7 @@ export class DisplayImpl implements Display {
 
   generateNextId(): number {
     if (this._recycledIds.length) {
-      return this._recycledIds.shift()!
+      return this._recycledIds.pop()!
     } else {
       return ++this._lastId
     }
@@ -255,11 +258,53 @@ export class DisplayImpl implements Display {
   }
 }
 
+/**
+ * Packs the pixels of the given rectangles one after the other, row by row, as expected by
+ * gr_web_shm_buffer.attach_damaged.
+ *
+ * @param pixels The RGBA8888 pixels of the complete buffer.
+ * @param width The buffer width in pixels.
+ * @param rectangles The damaged rectangles as x, y, width, height values.
+ * @param target An optional buffer to reuse, ie. one that was detached by the compositor. Only used if it's large
+ * enough.
+ */
+export function packDamagedPixels(pixels: ArrayBuffer, width: number, rectangles: Int32Array, target?: ArrayBuffer): ArrayBuffer {
+  let packedSize = 0
+  for (let i = 0; i < rectangles.length; i += 4) {
+    packedSize += rectangles[i + 2] * rectangles[i + 3]
+  }
+
+  const packed = target !== undefined && target.byteLength >= packedSize * 4 ? target : new ArrayBuffer(packedSize * 4)
+  // one RGBA8888 pixel fits exactly in one uint32
+  const source = new Uint32Array(pixels)
+  const destination = new Uint32Array(packed)
+  let offset = 0
+  for (let i = 0; i < rectangles.length; i += 4) {
+    const x = rectangles[i]
+    const y = rectangles[i + 1]
+    const rectWidth = rectangles[i + 2]
+    const rectHeight = rectangles[i + 3]
+    for (let row = y; row < y + rectHeight; row++) {
+      const rowStart = (row * width) + x
+      destination.set(source.subarray(rowStart, rowStart + rectWidth), offset)
+      offset += rectWidth
+    }
+  }
+  return packed
+}
+
 // TODO This is currently a literal copy of the server implementation. Do all use cases match 1o1 and can we use a single common code base between client & server for WebFS?
 export class WebFS {
   private readonly _fdDomainUUID: string
   private _webFDs: { [key: number]: WebFD } = {}
   private _nextFD: number = 0
+  private readonly _createURL = (webFD: WebFD): URL => {
+    const webFdURL = new URL(`client://`)
+    webFdURL.searchParams.append('fd', `${webFD.fd}`)
+    webFdURL.searchParams.append('type', webFD.type)
+    webFdURL.searchParams.append('clientId', this._fdDomainUUID)
+    return webFdURL
+  }
 
   static create(fdDomainUUID: string): WebFS {
     return new WebFS(fdDomainUUID)
@@ -271,14 +316,7 @@ export class WebFS {
 
   fromArrayBuffer(arrayBuffer: ArrayBuffer): WebFD {
     const fd = this._nextFD++
-    const type = 'ArrayBuffer'
-
-    const webFdURL = new URL(`client://`)
-    webFdURL.searchParams.append('fd', `${fd}`)
-    webFdURL.searchParams.append('type', type)
-    webFdURL.searchParams.append('clientId', this._fdDomainUUID)
-
-    const webFD = new WebFD(fd, type, webFdURL, () => Promise.resolve(arrayBuffer), () => {
+    const webFD = new WebFD(fd, 'ArrayBuffer', this._createURL, () => arrayBuffer, () => {
       delete this._webFDs[fd]
     })
     this._webFDs[fd] = webFD
@@ -287,14 +325,7 @@ export class WebFS {
 
   fromImageBitmap(imageBitmap: ImageBitmap): WebFD {
     const fd = this._nextFD++
-    const type = 'ImageBitmap'
-
-    const webFdURL = new URL(`client://`)
-    webFdURL.searchParams.append('fd', `${fd}`)
-    webFdURL.searchParams.append('type', type)
-    webFdURL.searchParams.append('clientId', this._fdDomainUUID)
-
-    const webFD = new WebFD(fd, type, webFdURL, () => Promise.resolve(imageBitmap), () => {
+    const webFD = new WebFD(fd, 'ImageBitmap', this._createURL, () => imageBitmap, () => {
       delete this._webFDs[fd]
     })
     this._webFDs[fd] = webFD
@@ -303,14 +334,7 @@ export class WebFS {
 
   fromOffscreenCanvas(offscreenCanvas: OffscreenCanvas): WebFD {
     const fd = this._nextFD++
-    const type = 'OffscreenCanvas'
-
-    const webFdURL = new URL(`client://`)
-    webFdURL.searchParams.append('fd', `${fd}`)
-    webFdURL.searchParams.append('type', type)
-    webFdURL.searchParams.append('clientId', this._fdDomainUUID)
-
-    const webFD = new WebFD(fd, type, webFdURL, () => Promise.resolve(offscreenCanvas), () => {
+    const webFD = new WebFD(fd, 'OffscreenCanvas', this._createURL, () => offscreenCanvas, () => {
       delete this._webFDs[fd]
     })
     this._webFDs[fd] = webFD
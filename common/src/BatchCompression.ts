@@ -0,0 +1,97 @@
+/*
+MIT License
+
+Copyright (c) 2020 Erik De Rijcke
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+const MIN_MATCH = 4
+
+/**
+ * Decodes a batch of wire messages that was compressed by the native endpoint. The encoded batch starts with its
+ * decoded size as a little endian uint32, followed by a single LZ4 block.
+ *
+ * @param encoded The compressed batch.
+ * @return The decoded batch.
+ */
+export function decompressBatch(encoded: Uint8Array): ArrayBuffer {
+  if (encoded.length < 4) {
+    throw new Error('Compressed batch too short.')
+  }
+  const decodedLength = (encoded[0] | (encoded[1] << 8) | (encoded[2] << 16) | (encoded[3] << 24)) >>> 0
+  const decoded = new Uint8Array(decodedLength)
+
+  let ip = 4
+  let op = 0
+  while (ip < encoded.length) {
+    const token = encoded[ip++]
+
+    let literalLength = token >>> 4
+    if (literalLength === 15) {
+      let extra
+      do {
+        extra = encoded[ip++]
+        literalLength += extra
+      } while (extra === 255)
+    }
+    if (ip + literalLength > encoded.length || op + literalLength > decodedLength) {
+      throw new Error('Corrupt compressed batch. Literals out of bounds.')
+    }
+    decoded.set(encoded.subarray(ip, ip + literalLength), op)
+    ip += literalLength
+    op += literalLength
+
+    // the last sequence only holds literals
+    if (ip >= encoded.length) {
+      break
+    }
+
+    const offset = encoded[ip] | (encoded[ip + 1] << 8)
+    ip += 2
+    let matchLength = token & 15
+    if (matchLength === 15) {
+      let extra
+      do {
+        extra = encoded[ip++]
+        matchLength += extra
+      } while (extra === 255)
+    }
+    matchLength += MIN_MATCH
+    if (offset === 0 || offset > op || op + matchLength > decodedLength) {
+      throw new Error('Corrupt compressed batch. Match out of bounds.')
+    }
+
+    const ref = op - offset
+    if (offset >= matchLength) {
+      decoded.copyWithin(op, ref, ref + matchLength)
+      op += matchLength
+    } else {
+      // overlapping match, repeats the last offset bytes
+      for (let i = 0; i < matchLength; i++, op++) {
+        decoded[op] = decoded[ref + i]
+      }
+    }
+  }
+
+  if (op !== decodedLength) {
+    throw new Error(`Corrupt compressed batch. Expected ${decodedLength} bytes, got ${op}.`)
+  }
+  return decoded.buffer
+}
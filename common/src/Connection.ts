@@ -23,31 +23,85 @@ SOFTWARE.
 */
 const textDecoder = new TextDecoder('utf8')
 
+/*
+ * IDs allocated by the client are in the range [1, 0xfeffffff] while IDs allocated by the server are
+ * in the range [0xff000000, 0xffffffff]. The 0 ID is reserved to represent a null or non-existent object
+ */
+export const SERVER_OBJECT_ID_BASE = 0xff000000
+
+interface DestroyListenerLink {
+  readonly listener: (wlObject: WlObject) => void
+  next?: DestroyListenerLink
+}
+
 export class WlObject {
   readonly id: number
-  // @ts-ignore
-  private _destroyResolver: () => void
-  private readonly _destroyPromise: Promise<void> = new Promise(resolve => this._destroyResolver = resolve)
-  private _destroyListeners: ((wlObject: WlObject) => void)[] = []
+  private _destroyed: boolean = false
+  private _destroyListeners?: DestroyListenerLink = undefined
+  private _destroyPromise?: Promise<void> = undefined
 
   constructor(id: number) {
     this.id = id
-    this._destroyPromise.then(() => this._destroyListeners.forEach(destroyListener => destroyListener(this)))
   }
 
+  /**
+   * Notifies all destroy listeners, in the order they were added. Listeners are called synchronously.
+   */
   destroy() {
-    this._destroyResolver()
+    if (this._destroyed) {
+      return
+    }
+    this._destroyed = true
+
+    let link = this._destroyListeners
+    this._destroyListeners = undefined
+    while (link) {
+      const next = link.next
+      link.listener(this)
+      link = next
+    }
   }
 
   addDestroyListener(destroyListener: (wlObject: WlObject) => void) {
-    this._destroyListeners.push(destroyListener)
+    const link: DestroyListenerLink = { listener: destroyListener }
+    if (this._destroyListeners === undefined) {
+      this._destroyListeners = link
+      return
+    }
+
+    let tail = this._destroyListeners
+    while (tail.next) {
+      tail = tail.next
+    }
+    tail.next = link
   }
 
   removeDestroyListener(destroyListener: (wlObject: WlObject) => void) {
-    this._destroyListeners = this._destroyListeners.filter((item) => item !== destroyListener)
+    let previous: DestroyListenerLink | undefined = undefined
+    let link = this._destroyListeners
+    while (link) {
+      if (link.listener === destroyListener) {
+        if (previous) {
+          previous.next = link.next
+        } else {
+          this._destroyListeners = link.next
+        }
+      } else {
+        previous = link
+      }
+      link = link.next
+    }
   }
 
-  onDestroy() {
+  /**
+   * The returned promise is only created on first use, most objects are never awaited.
+   */
+  onDestroy(): Promise<void> {
+    if (this._destroyPromise === undefined) {
+      this._destroyPromise = this._destroyed ?
+        Promise.resolve() :
+        new Promise(resolve => this.addDestroyListener(() => resolve()))
+    }
     return this._destroyPromise
   }
 }
@@ -84,31 +138,68 @@ export class Fixed {
   }
 }
 
+export type WebFDType = 'ImageBitmap' | 'ArrayBuffer' | 'MessagePort' | 'OffscreenCanvas'
+
 export class WebFD {
   readonly fd: number
-  readonly type: 'ImageBitmap' | 'ArrayBuffer' | 'MessagePort' | 'OffscreenCanvas'
-  readonly url: URL
-  private readonly _onGetTransferable: (webFd: WebFD) => Promise<Transferable>
+  readonly type: WebFDType
+  private _url?: URL
+  private readonly _urlFactory?: (webFd: WebFD) => URL
+  private readonly _onGetTransferable: (webFd: WebFD) => Transferable | Promise<Transferable>
   private readonly _onClose: (webFd: WebFD) => void
 
+  /**
+   * @param fd
+   * @param fdType
+   * @param fdURL The url of this fd, or a factory to create it. The factory is only called if the url is actually
+   * needed ie. when the fd leaves the process. A single factory can be shared by all fds of the same domain.
+   * @param onGetTransferable Can return the transferable directly if it's readily available.
+   * @param onClose
+   */
   constructor(
     fd: number,
-    fdType: 'ImageBitmap' | 'ArrayBuffer' | 'MessagePort' | 'OffscreenCanvas',
-    fdURL: URL,
-    onGetTransferable: (webFd: WebFD) => Promise<Transferable>,
+    fdType: WebFDType,
+    fdURL: URL | ((webFd: WebFD) => URL),
+    onGetTransferable: (webFd: WebFD) => Transferable | Promise<Transferable>,
     onClose: (webFd: WebFD) => void
   ) {
     this.fd = fd
     this.type = fdType
-    this.url = fdURL
+    if (fdURL instanceof URL) {
+      this._url = fdURL
+    } else {
+      this._urlFactory = fdURL
+    }
     this._onGetTransferable = onGetTransferable
     this._onClose = onClose
   }
 
+  get url(): URL {
+    if (this._url === undefined) {
+      this._url = this._urlFactory!(this)
+    }
+    return this._url
+  }
+
   async getTransferable(): Promise<Transferable> {
     return await this._onGetTransferable(this)
   }
 
+  /**
+   * Resolves the transferables of all given fds at once, in order. Transferables that are readily available are
+   * collected synchronously so a whole flush costs a single await instead of one per fd.
+   */
+  static getTransferables(webFds: WebFD[]): Promise<Transferable[]> {
+    const transferables: (Transferable | Promise<Transferable>)[] = new Array(webFds.length)
+    let pending = false
+    for (let i = 0; i < webFds.length; i++) {
+      const transferable = webFds[i]._onGetTransferable(webFds[i])
+      pending = pending || transferable instanceof Promise
+      transferables[i] = transferable
+    }
+    return pending ? Promise.all(transferables) : Promise.resolve(transferables as Transferable[])
+  }
+
   close() {
     this._onClose(this)
   }
@@ -138,6 +229,12 @@ export interface SendMessage {
   fds: Array<WebFD>
 }
 
+interface OutMessage extends SendMessage {
+  readonly id: number,
+  readonly opcode: number,
+  readonly obsoletable: boolean
+}
+
 export function uint(arg: number): MessageMarshallingContext<number, 'u', 4> {
   return {
     value: arg,
@@ -322,7 +419,7 @@ export function array(arg: ArrayBufferView): MessageMarshallingContext<ArrayBuff
       new Uint32Array(wireMsg.buffer, wireMsg.bufferOffset, 1)[0] = this.value.byteLength
 
       const byteLength = this.value.byteLength
-      new Uint8Array(wireMsg.buffer, wireMsg.bufferOffset + 4, byteLength).set(new Uint8Array(this.value.buffer, 0, byteLength))
+      new Uint8Array(wireMsg.buffer, wireMsg.bufferOffset + 4, byteLength).set(new Uint8Array(this.value.buffer, this.value.byteOffset, byteLength))
 
       wireMsg.bufferOffset += this.size
     },
@@ -352,7 +449,7 @@ export function arrayOptional(arg?: ArrayBufferView): MessageMarshallingContext<
         new Uint32Array(wireMsg.buffer, wireMsg.bufferOffset, 1)[0] = this.value.byteLength
 
         const byteLength = this.value.byteLength
-        new Uint8Array(wireMsg.buffer, wireMsg.bufferOffset + 4, byteLength).set(new Uint8Array(this.value.buffer, 0, byteLength))
+        new Uint8Array(wireMsg.buffer, wireMsg.bufferOffset + 4, byteLength).set(new Uint8Array(this.value.buffer, this.value.byteOffset, byteLength))
       }
       wireMsg.bufferOffset += this.size
     },
@@ -395,7 +492,7 @@ export function oOptional<T extends WlObject>(message: WlMessage, connection: Co
   if (arg === 0) {
     return undefined
   } else {
-    const wlObject = connection.wlObjects[arg]
+    const wlObject = connection.wlObjects.get(arg)
     if (wlObject) {
       // TODO add an extra check to make sure we cast correctly
       return wlObject as T
@@ -409,7 +506,7 @@ export function o<T extends WlObject>(message: WlMessage, connection: Connection
   checkMessageSize(message, 4)
   const arg = message.buffer[message.bufferOffset++]
 
-  const wlObject = connection.wlObjects[arg]
+  const wlObject = connection.wlObjects.get(arg)
   if (wlObject) {
     // TODO add an extra check to make sure we cast correctly
     return wlObject as T
@@ -423,6 +520,67 @@ export function n(message: WlMessage): number {
   return message.buffer[message.bufferOffset++]
 }
 
+// Must be a power of 2.
+const STRING_INTERN_CACHE_SIZE = 256
+// Longer strings are unlikely to repeat, don't bother looking them up.
+const STRING_INTERN_MAX_LENGTH = 64
+const stringInternCache: (string | undefined)[] = new Array(STRING_INTERN_CACHE_SIZE).fill(undefined)
+let stringBytesSource: ArrayBuffer | undefined = undefined
+let stringBytes: Uint8Array = new Uint8Array(0)
+
+/**
+ * Byte view of the given buffer. The view is reused for as long as strings are read from the same buffer.
+ */
+function bytesOf(buffer: ArrayBuffer): Uint8Array {
+  if (stringBytesSource !== buffer) {
+    stringBytesSource = buffer
+    stringBytes = new Uint8Array(buffer)
+  }
+  return stringBytes
+}
+
+/**
+ * Decodes a string of the given byte length, null terminator excluded, at the current message offset. Short ASCII
+ * strings are looked up in a small cache using an FNV-1a hash of their content, so strings that keep repeating
+ * (interface names, mime types, app ids, cursor names...) are decoded without allocation.
+ */
+function decodeString(message: WlMessage, length: number): string {
+  const byteOffset = message.buffer.byteOffset + (message.bufferOffset * Uint32Array.BYTES_PER_ELEMENT)
+  if (length > STRING_INTERN_MAX_LENGTH) {
+    return textDecoder.decode(new Uint8Array(message.buffer.buffer, byteOffset, length))
+  }
+
+  const bytes = bytesOf(message.buffer.buffer)
+  let hash = 0x811c9dc5
+  let bits = 0
+  for (let i = byteOffset; i < byteOffset + length; i++) {
+    const byte = bytes[i]
+    bits |= byte
+    hash = Math.imul(hash ^ byte, 0x01000193)
+  }
+
+  if (bits & 0x80) {
+    // not ASCII
+    return textDecoder.decode(bytes.subarray(byteOffset, byteOffset + length))
+  }
+
+  const slot = hash & (STRING_INTERN_CACHE_SIZE - 1)
+  const cached = stringInternCache[slot]
+  if (cached !== undefined && cached.length === length) {
+    let i = 0
+    while (i < length && cached.charCodeAt(i) === bytes[byteOffset + i]) {
+      i++
+    }
+    if (i === length) {
+      return cached
+    }
+  }
+
+  const value = String.fromCharCode.apply(null, bytes.subarray(byteOffset, byteOffset + length) as unknown as number[])
+  stringInternCache[slot] = value
+  return value
+}
+
 export function sOptional(message: WlMessage): string | undefined { // {String}
   checkMessageSize(message, 4)
   const stringSize = message.buffer[message.bufferOffset++]
@@ -432,9 +590,9 @@ export function sOptional(message: WlMessage): string | undefined { // {String}
     const alignedSize = ((stringSize + 3) & ~3)
     checkMessageSize(message, alignedSize)
     // size -1 to eliminate null byte
-    const byteArray = new Uint8Array(message.buffer.buffer, message.buffer.byteOffset + (message.bufferOffset * Uint32Array.BYTES_PER_ELEMENT), stringSize - 1)
+    const value = decodeString(message, stringSize - 1)
     message.bufferOffset += (alignedSize / 4)
-    return textDecoder.decode(byteArray)
+    return value
   }
 }
 
@@ -445,9 +603,9 @@ export function s(message: WlMessage): string { // {String}
   const alignedSize = ((stringSize + 3) & ~3)
   checkMessageSize(message, alignedSize)
   // size -1 to eliminate null byte
-  const byteArray = new Uint8Array(message.buffer.buffer, message.buffer.byteOffset + (message.bufferOffset * Uint32Array.BYTES_PER_ELEMENT), stringSize - 1)
+  const value = decodeString(message, stringSize - 1)
   message.bufferOffset += (alignedSize / 4)
-  return textDecoder.decode(byteArray)
+  return value
 }
 
 export function aOptional(message: WlMessage, optional: boolean): ArrayBuffer | undefined {
@@ -487,10 +645,100 @@ export function h(message: WlMessage): WebFD { // file descriptor {number}
   }
 }
 
+/**
+ * Maps object ids to objects. Client and server allocated ids each get their own array, indexed by the id's offset
+ * in its range. As ids are handed out sequentially and recycled, both arrays stay dense and lookups never fall back
+ * to dictionary mode property access. Same approach as libwayland's wl_map.
+ */
+/**
+ * Ids further than this beyond the highest id in the table are not packed densely, a misbehaving client could otherwise
+ * make us allocate billions of slots with a single bogus new_id.
+ */
+const MAX_ID_GAP = 4096
+
+export class WlObjectTable {
+  private readonly _clientObjects: (WlObject | undefined)[] = [undefined]
+  private readonly _serverObjects: (WlObject | undefined)[] = []
+  private readonly _sparseObjects: Map<number, WlObject> = new Map()
+
+  get(id: number): WlObject | undefined {
+    const wlObject =
+      id >= SERVER_OBJECT_ID_BASE ? this._serverObjects[id - SERVER_OBJECT_ID_BASE] : this._clientObjects[id]
+    if (wlObject === undefined && this._sparseObjects.size) {
+      return this._sparseObjects.get(id)
+    }
+    return wlObject
+  }
+
+  has(id: number): boolean {
+    return this.get(id) !== undefined
+  }
+
+  set(wlObject: WlObject) {
+    const serverId = wlObject.id >= SERVER_OBJECT_ID_BASE
+    const objects = serverId ? this._serverObjects : this._clientObjects
+    const index = serverId ? wlObject.id - SERVER_OBJECT_ID_BASE : wlObject.id
+    if (index > objects.length + MAX_ID_GAP) {
+      this._sparseObjects.set(wlObject.id, wlObject)
+      return
+    }
+    // Ids are handed out sequentially by the client, but objects that are handled by the native endpoint alone, eg. shm
+    // pools, never reach us. Fill the gaps they leave so the array stays densely packed.
+    for (let i = objects.length; i < index; i++) {
+      objects.push(undefined)
+    }
+    objects[index] = wlObject
+  }
+
+  delete(id: number) {
+    const serverId = id >= SERVER_OBJECT_ID_BASE
+    const objects = serverId ? this._serverObjects : this._clientObjects
+    const index = serverId ? id - SERVER_OBJECT_ID_BASE : id
+    this._sparseObjects.delete(id)
+    if (index >= objects.length) {
+      return
+    }
+    // keep the slot, the id it belongs to will be recycled
+    objects[index] = undefined
+  }
+
+  /**
+   * All registered objects, in ascending id order.
+   */
+  values(): WlObject[] {
+    const values: WlObject[] = []
+    for (const wlObject of this._clientObjects) {
+      if (wlObject !== undefined) {
+        values.push(wlObject)
+      }
+    }
+    for (const wlObject of this._serverObjects) {
+      if (wlObject !== undefined) {
+        values.push(wlObject)
+      }
+    }
+    if (this._sparseObjects.size) {
+      values.push(...this._sparseObjects.values())
+      values.sort((a, b) => a.id - b.id)
+    }
+    return values
+  }
+}
+
 export class Connection {
-  readonly wlObjects: { [key: number]: WlObject } = {}
+  readonly wlObjects: WlObjectTable = new WlObjectTable()
   closed: boolean = false
   onFlush?: (outMsg: SendMessage[]) => void
+  /**
+   * Amount of flushed bytes that may not yet have been released by the transport before flushing is halted. Messages
+   * queue up until the transport catches up. Undefined means no limit, flushed bytes are then not counted at all.
+   */
+  highWaterMark?: number
+  /**
+   * Fired when the transport has released enough bytes to drop below the high water mark again.
+   */
+  onDrain?: () => void
+  private _bytesInFlight: number = 0
   private _outMessages: SendMessage[] = []
   private _inMessages: WlMessage[] = []
   private _idleHandlers: (() => any)[] = []
@@ -507,11 +755,22 @@ export class Connection {
     this._idleHandlers = this._idleHandlers.filter(handler => handler !== idleHandler)
   }
 
-  marshallMsg(id: number, opcode: number, size: number, argsArray: MessageMarshallingContext<any, any, any>[]) {
+  /**
+   * @param id
+   * @param opcode
+   * @param size
+   * @param argsArray
+   * @param obsoletable If the message can be superseded by a newer message with the same id and opcode, like pointer
+   * motion. While the connection is not writable, such a message replaces any older queued one.
+   */
+  marshallMsg(id: number, opcode: number, size: number, argsArray: MessageMarshallingContext<any, any, any>[], obsoletable: boolean = false) {
     const wireMsg = {
       buffer: new ArrayBuffer(size),
       fds: [],
-      bufferOffset: 0
+      bufferOffset: 0,
+      id,
+      opcode,
+      obsoletable
     }
 
     // write actual wire message
@@ -524,9 +783,53 @@ export class Connection {
 
     // write actual argument value to buffer
     argsArray.forEach((arg) => arg._marshallArg(wireMsg))
+    if (obsoletable && !this.writable) {
+      this._removeObsoleted(id, opcode)
+    }
     this.onSend(wireMsg)
   }
 
+  /**
+   * Removes the most recent queued message with the given id and opcode, provided no message to the same object
+   * that can not be obsoleted was queued after it, nor in the group of messages to that object that precede it since
+   * the previous message with the same opcode. Dropping eg. a pointer frame would otherwise merge a button event of its
+   * group into the next frame.
+   */
+  private _removeObsoleted(id: number, opcode: number) {
+    for (let i = this._outMessages.length - 1; i >= 0; i--) {
+      const outMessage = this._outMessages[i] as OutMessage
+      if (outMessage.id !== id) {
+        continue
+      }
+      if (!outMessage.obsoletable) {
+        return
+      }
+      if (outMessage.opcode === opcode) {
+        if (this._groupObsoletable(i)) {
+          this._outMessages.splice(i, 1)
+        }
+        return
+      }
+    }
+  }
+
+  private _groupObsoletable(index: number): boolean {
+    const { id, opcode } = this._outMessages[index] as OutMessage
+    for (let i = index - 1; i >= 0; i--) {
+      const outMessage = this._outMessages[i] as OutMessage
+      if (outMessage.id !== id) {
+        continue
+      }
+      if (!outMessage.obsoletable) {
+        return false
+      }
+      if (outMessage.opcode === opcode) {
+        return true
+      }
+    }
+    return true
+  }
+
   private _idle() {
     const idleHandlers = [...this._idleHandlers]
     this._idleHandlers = []
@@ -570,7 +873,7 @@ export class Connection {
             throw new Error('Request buffer too small')
           }
 
-          const wlObject = this.wlObjects[id]
+          const wlObject = this.wlObjects.get(id)
           if (wlObject) {
             wireMessages.bufferOffset += 2
             wireMessages.consumed = 8
@@ -616,6 +919,29 @@ ${e.stack}
     this._outMessages.push(wireMsg)
   }
 
+  /**
+   * False if the transport has not yet released enough flushed bytes to drop below the high water mark.
+   */
+  get writable(): boolean {
+    return this.highWaterMark === undefined || this._bytesInFlight < this.highWaterMark
+  }
+
+  get bytesInFlight(): number {
+    return this._bytesInFlight
+  }
+
+  /**
+   * To be called by the transport once the given amount of flushed bytes have actually been send.
+   */
+  releaseBytesInFlight(byteLength: number) {
+    const wasWritable = this.writable
+    this._bytesInFlight = Math.max(0, this._bytesInFlight - byteLength)
+    if (!wasWritable && this.writable) {
+      this.flush()
+      this.onDrain?.()
+    }
+  }
+
   flush() {
     if (this.closed) {
       return
@@ -623,7 +949,17 @@ ${e.stack}
     if (this._outMessages.length === 0) {
       return
     }
+    if (!this.writable) {
+      // keep queueing, we'll flush once the transport drains
+      return
+    }
 
+    // only keep count when there is a limit, transports that don't care about it never release anything
+    if (this.highWaterMark !== undefined) {
+      for (const outMessage of this._outMessages) {
+        this._bytesInFlight += outMessage.buffer.byteLength
+      }
+    }
     this.onFlush?.(this._outMessages)
     this._outMessages = []
   }
@@ -634,7 +970,7 @@ ${e.stack}
     }
 
     // destroy resources in descending order
-    Object.values(this.wlObjects).sort((a, b) => a.id - b.id).forEach((wlObject) => wlObject.destroy())
+    this.wlObjects.values().forEach((wlObject) => wlObject.destroy())
     this.closed = true
   }
 
@@ -642,16 +978,16 @@ ${e.stack}
     if (this.closed) {
       return
     }
-    if (wlObject.id in this.wlObjects) {
+    if (this.wlObjects.has(wlObject.id)) {
       throw new Error(`Illegal object id: ${wlObject.id}. Already registered.`)
     }
-    this.wlObjects[wlObject.id] = wlObject
+    this.wlObjects.set(wlObject)
   }
 
   unregisterWlObject(wlObject: WlObject) {
     if (this.closed) {
       return
     }
-    delete this.wlObjects[wlObject.id]
+    this.wlObjects.delete(wlObject.id)
   }
 }
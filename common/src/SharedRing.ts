@@ -0,0 +1,219 @@
+/*
+MIT License
+
+Copyright (c) 2020 Erik De Rijcke
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// header slots, each an int32
+const HEAD = 0
+const TAIL = 1
+const READER_WAITING = 2
+const WRITER_WAITING = 3
+const HEADER_BYTE_SIZE = 16
+// each frame starts with its payload size in words, followed by the number of fds that belong to it
+const FRAME_HEADER_WORDS = 2
+
+export interface SharedRingFrame {
+  buffer: Uint32Array,
+  fdCount: number
+}
+
+/**
+ * A single producer, single consumer ring of protocol messages on top of a SharedArrayBuffer. One ring is used per
+ * direction. Each flush is written as a single frame so the receiving side does not need an event-loop task per
+ * message. Fds can not be shared this way and still have to be send over a side channel eg. postMessage. Each frame
+ * records how many fds it expects so the receiver can hold it back until they have arrived.
+ *
+ * Head and tail are free running word counters. Only the producer writes the head and only the consumer writes the
+ * tail.
+ */
+export class SharedRing {
+  readonly sharedBuffer: SharedArrayBuffer
+  private readonly _header: Int32Array
+  private readonly _data: Uint32Array
+  private readonly _capacity: number
+  private readonly _mask: number
+  private _seenHead: number = 0
+
+  /**
+   * @param byteCapacity Size of the message area, rounded up to a power of two.
+   */
+  static create(byteCapacity: number): SharedRing {
+    let capacity = 1
+    while (capacity < (byteCapacity >>> 2)) {
+      capacity <<= 1
+    }
+    return new SharedRing(new SharedArrayBuffer(HEADER_BYTE_SIZE + (capacity << 2)))
+  }
+
+  /**
+   * Wraps a ring that was created elsewhere, typically by the other end of the connection.
+   */
+  constructor(sharedBuffer: SharedArrayBuffer) {
+    const capacity = (sharedBuffer.byteLength - HEADER_BYTE_SIZE) >>> 2
+    if (capacity < FRAME_HEADER_WORDS || (capacity & (capacity - 1)) !== 0) {
+      throw new Error(`Shared ring capacity must be a power of two, got ${capacity} words.`)
+    }
+    this.sharedBuffer = sharedBuffer
+    this._header = new Int32Array(sharedBuffer, 0, HEADER_BYTE_SIZE >>> 2)
+    this._data = new Uint32Array(sharedBuffer, HEADER_BYTE_SIZE, capacity)
+    this._capacity = capacity
+    this._mask = capacity - 1
+  }
+
+  /**
+   * Largest message payload in bytes that fits in a single frame.
+   */
+  get maxFrameByteLength(): number {
+    return (this._capacity - FRAME_HEADER_WORDS) << 2
+  }
+
+  /**
+   * Writes all given messages as a single frame.
+   *
+   * @return false if there is not enough free space. Nothing is written in that case.
+   * @throws Error if the messages exceed maxFrameByteLength, they can never be written. Callers must check this first.
+   */
+  write(messages: { buffer: ArrayBuffer }[], fdCount: number): boolean {
+    let words = 0
+    for (const message of messages) {
+      words += message.buffer.byteLength >>> 2
+    }
+    if (words + FRAME_HEADER_WORDS > this._capacity) {
+      throw new Error(`Frame of ${words << 2} bytes exceeds shared ring capacity.`)
+    }
+
+    const head = Atomics.load(this._header, HEAD) >>> 0
+    const tail = Atomics.load(this._header, TAIL) >>> 0
+    if (this._capacity - ((head - tail) >>> 0) < words + FRAME_HEADER_WORDS) {
+      return false
+    }
+
+    this._data[head & this._mask] = words
+    this._data[(head + 1) & this._mask] = fdCount
+    let position = head + FRAME_HEADER_WORDS
+    for (const message of messages) {
+      const source = new Uint32Array(message.buffer, 0, message.buffer.byteLength >>> 2)
+      this._put(position, source)
+      position += source.length
+    }
+
+    Atomics.store(this._header, HEAD, position | 0)
+    if (Atomics.load(this._header, READER_WAITING)) {
+      Atomics.notify(this._header, HEAD)
+    }
+    return true
+  }
+
+  /**
+   * The fd count of the next frame, or undefined if there is none.
+   */
+  peekFdCount(): number | undefined {
+    const tail = Atomics.load(this._header, TAIL) >>> 0
+    this._seenHead = Atomics.load(this._header, HEAD)
+    if ((this._seenHead >>> 0) === tail) {
+      return undefined
+    }
+    return this._data[(tail + 1) & this._mask]
+  }
+
+  /**
+   * Copies out the next frame and frees its space in the ring.
+   */
+  read(): SharedRingFrame | undefined {
+    const tail = Atomics.load(this._header, TAIL) >>> 0
+    this._seenHead = Atomics.load(this._header, HEAD)
+    if ((this._seenHead >>> 0) === tail) {
+      return undefined
+    }
+
+    const words = this._data[tail & this._mask]
+    const fdCount = this._data[(tail + 1) & this._mask]
+    const buffer = new Uint32Array(words)
+    const start = (tail + FRAME_HEADER_WORDS) & this._mask
+    const firstPart = Math.min(words, this._capacity - start)
+    buffer.set(this._data.subarray(start, start + firstPart))
+    if (firstPart < words) {
+      buffer.set(this._data.subarray(0, words - firstPart), firstPart)
+    }
+
+    Atomics.store(this._header, TAIL, (tail + FRAME_HEADER_WORDS + words) | 0)
+    if (Atomics.load(this._header, WRITER_WAITING)) {
+      Atomics.notify(this._header, TAIL)
+    }
+    return { buffer, fdCount }
+  }
+
+  /**
+   * Blocks until the producer has written something that was not yet seen by the last read or peek. Can only be used
+   * where blocking is allowed, ie. in a worker.
+   *
+   * @return false on timeout
+   */
+  waitReadable(timeout?: number): boolean {
+    Atomics.store(this._header, READER_WAITING, 1)
+    const result = Atomics.wait(this._header, HEAD, this._seenHead, timeout)
+    Atomics.store(this._header, READER_WAITING, 0)
+    return result !== 'timed-out'
+  }
+
+  /**
+   * Like waitReadable but without blocking the calling thread. Requires Atomics.waitAsync.
+   */
+  async waitReadableAsync(): Promise<void> {
+    Atomics.store(this._header, READER_WAITING, 1)
+    await waitAsync(this._header, HEAD, this._seenHead)
+    Atomics.store(this._header, READER_WAITING, 0)
+  }
+
+  /**
+   * Resolves once the consumer has freed enough space to write the given amount of message bytes. Requires
+   * Atomics.waitAsync.
+   */
+  async waitWritableAsync(byteLength: number): Promise<void> {
+    const words = (byteLength >>> 2) + FRAME_HEADER_WORDS
+    while (true) {
+      Atomics.store(this._header, WRITER_WAITING, 1)
+      const tail = Atomics.load(this._header, TAIL)
+      const head = Atomics.load(this._header, HEAD) >>> 0
+      if (this._capacity - ((head - (tail >>> 0)) >>> 0) >= words) {
+        break
+      }
+      await waitAsync(this._header, TAIL, tail)
+    }
+    Atomics.store(this._header, WRITER_WAITING, 0)
+  }
+
+  private _put(position: number, source: Uint32Array) {
+    const start = position & this._mask
+    const firstPart = Math.min(source.length, this._capacity - start)
+    this._data.set(firstPart === source.length ? source : source.subarray(0, firstPart), start)
+    if (firstPart < source.length) {
+      this._data.set(source.subarray(firstPart), 0)
+    }
+  }
+}
+
+function waitAsync(header: Int32Array, index: number, value: number): Promise<unknown> {
+  // not yet part of the typescript lib definitions
+  const result: { async: boolean, value: Promise<unknown> | string } = (Atomics as any).waitAsync(header, index, value)
+  return result.async ? result.value as Promise<unknown> : Promise.resolve(result.value)
+}
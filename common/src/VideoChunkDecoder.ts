@@ -0,0 +1,108 @@
+/*
+MIT License
+
+Copyright (c) 2020 Erik De Rijcke
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+import { decompressBatch } from './BatchCompression'
+
+const KEYFRAME = 1
+const VP8 = 2
+const HEADER_WORDS = 4
+
+export interface VideoFrame {
+  width: number,
+  height: number,
+  /**
+   * Packed 32 bit pixels in the byte order of the originating shm buffer.
+   */
+  pixels: Uint8Array
+}
+
+export interface Vp8Chunk {
+  keyframe: boolean,
+  width: number,
+  height: number,
+  /**
+   * A single VP8 frame, as expected by a WebCodecs EncodedVideoChunk.
+   */
+  data: Uint8Array
+}
+
+/**
+ * Decodes the chunks of a single native video encoder, see Endpoint.createVideoEncoder. Delta chunks depend on the
+ * previous frame so chunks must be decoded in order, starting with a keyframe.
+ *
+ * Only chunks of the lossy delta codec are decoded here. Encoders built with libvpx produce VP8 chunks instead, those
+ * are unwrapped with parseVp8 and decoded by a WebCodecs VideoDecoder configured with codec 'vp8'.
+ */
+export class VideoChunkDecoder {
+  static isVp8(chunk: ArrayBuffer): boolean {
+    return (new DataView(chunk, 0, HEADER_WORDS * 4).getUint32(0, true) & VP8) !== 0
+  }
+
+  static parseVp8(chunk: ArrayBuffer): Vp8Chunk {
+    const header = new DataView(chunk, 0, HEADER_WORDS * 4)
+    const flags = header.getUint32(0, true)
+    if ((flags & VP8) === 0) {
+      throw new Error('Video chunk is not a VP8 frame.')
+    }
+    return {
+      keyframe: (flags & KEYFRAME) !== 0,
+      width: header.getUint32(4, true),
+      height: header.getUint32(8, true),
+      data: new Uint8Array(chunk, HEADER_WORDS * 4)
+    }
+  }
+
+  private _frame?: Uint32Array = undefined
+  private _width: number = 0
+  private _height: number = 0
+
+  decode(chunk: ArrayBuffer): VideoFrame {
+    const header = new DataView(chunk, 0, HEADER_WORDS * 4)
+    const flags = header.getUint32(0, true)
+    const width = header.getUint32(4, true)
+    const height = header.getUint32(8, true)
+    if (flags & VP8) {
+      throw new Error('VP8 video chunks are decoded with a WebCodecs VideoDecoder, see parseVp8.')
+    }
+    const residual = new Uint32Array(decompressBatch(new Uint8Array(chunk, HEADER_WORDS * 4)))
+
+    let frame = this._frame
+    if (flags & KEYFRAME) {
+      frame = residual
+      this._width = width
+      this._height = height
+    } else {
+      if (frame === undefined || this._width !== width || this._height !== height) {
+        throw new Error('Video delta chunk without matching keyframe.')
+      }
+      for (let i = 0; i < frame.length; i++) {
+        frame[i] ^= residual[i]
+      }
+    }
+    this._frame = frame
+
+    // a copy, the next delta is applied in place
+    return { width, height, pixels: new Uint8Array(frame.slice().buffer) }
+  }
+}
@@ -1 +1,4 @@
 export * from './Connection'
+export * from './SharedRing'
+export * from './BatchCompression'
+export * from './VideoChunkDecoder'
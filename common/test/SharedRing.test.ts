@@ -0,0 +1,74 @@
+import { Worker } from 'worker_threads'
+import { SharedRing } from '../src/SharedRing'
+
+// the producer runs in a real worker thread, compiled on the fly as the test runner does not reach into workers
+const producerSource = `
+require('ts-node').register({ transpileOnly: true, compilerOptions: { module: 'commonjs' } })
+const { workerData } = require('worker_threads')
+const { SharedRing } = require(workerData.modulePath)
+
+const keepAlive = setInterval(() => {}, 1000)
+const ring = new SharedRing(workerData.sharedBuffer)
+
+async function produce() {
+  for (let frame = 0; frame < workerData.frames; frame++) {
+    // odd sizes and split messages make frames straddle the end of the ring
+    const length = (frame % 13) + 1
+    const words = new Uint32Array(length).map((value, index) => frame + index)
+    const messages = [{ buffer: words.buffer.slice(0, (length >> 1) * 4) }, { buffer: words.buffer.slice((length >> 1) * 4) }]
+    while (!ring.write(messages, frame % 3)) {
+      await ring.waitWritableAsync(length * 4)
+    }
+  }
+  clearInterval(keepAlive)
+}
+produce()
+`
+
+describe('SharedRing', () => {
+  it('delivers frames in order between threads', async () => {
+    // given
+    const frames = 5000
+    const ring = SharedRing.create(256)
+
+    // when
+    const producer = new Worker(producerSource, {
+      eval: true,
+      workerData: { sharedBuffer: ring.sharedBuffer, modulePath: require.resolve('../src/SharedRing'), frames }
+    })
+    const received: { buffer: Uint32Array, fdCount: number }[] = []
+    while (received.length < frames) {
+      const frame = ring.read()
+      if (frame === undefined) {
+        ring.waitReadable(1000)
+      } else {
+        received.push(frame)
+      }
+    }
+    await producer.terminate()
+
+    // then
+    received.forEach((frame, index) => {
+      expect(frame.fdCount).toBe(index % 3)
+      expect(Array.from(frame.buffer)).toEqual(Array.from({ length: (index % 13) + 1 }, (value, word) => index + word))
+    })
+  })
+
+  it('refuses writes that do not fit until the reader catches up', () => {
+    // given
+    const ring = SharedRing.create(64)
+    const message = { buffer: new Uint32Array(7).buffer }
+
+    // when
+    const firstWrite = ring.write([message], 0)
+    const secondWrite = ring.write([message], 0)
+    ring.read()
+    const thirdWrite = ring.write([message], 0)
+
+    // then
+    expect(firstWrite).toBe(true)
+    expect(secondWrite).toBe(false)
+    expect(thirdWrite).toBe(true)
+    expect(ring.peekFdCount()).toBe(0)
+  })
+})
@@ -0,0 +1,40 @@
+import { VideoChunkDecoder } from '../src/VideoChunkDecoder'
+
+function vp8Chunk(flags: number, width: number, height: number, frame: number[]): ArrayBuffer {
+  const chunk = new ArrayBuffer(16 + frame.length)
+  const header = new DataView(chunk)
+  header.setUint32(0, flags, true)
+  header.setUint32(4, width, true)
+  header.setUint32(8, height, true)
+  new Uint8Array(chunk, 16).set(frame)
+  return chunk
+}
+
+describe('VideoChunkDecoder', () => {
+  it('unwraps VP8 frames for a WebCodecs decoder', () => {
+    // given
+    const chunk = vp8Chunk(3, 641, 481, [0x9d, 0x01, 0x2a])
+
+    // when
+    const vp8 = VideoChunkDecoder.parseVp8(chunk)
+
+    // then
+    expect(VideoChunkDecoder.isVp8(chunk)).toBe(true)
+    expect(vp8.keyframe).toBe(true)
+    expect(vp8.width).toBe(641)
+    expect(vp8.height).toBe(481)
+    expect(Array.from(vp8.data)).toEqual([0x9d, 0x01, 0x2a])
+  })
+
+  it('does not decode VP8 frames as delta chunks', () => {
+    // given
+    const chunk = vp8Chunk(2, 16, 16, [1, 2, 3])
+
+    // when
+    const decode = () => new VideoChunkDecoder().decode(chunk)
+
+    // then
+    expect(VideoChunkDecoder.isVp8(chunk)).toBe(true)
+    expect(decode).toThrow()
+  })
+})
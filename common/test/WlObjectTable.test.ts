@@ -0,0 +1,36 @@
+import { SERVER_OBJECT_ID_BASE, WlObject, WlObjectTable } from '../src/Connection'
+
+describe('WlObjectTable', () => {
+  it('finds objects across gaps in the ids', () => {
+    // given
+    const table = new WlObjectTable()
+
+    // when
+    table.set(new WlObject(1))
+    table.set(new WlObject(7))
+    table.set(new WlObject(SERVER_OBJECT_ID_BASE + 3))
+
+    // then
+    expect(table.get(1)?.id).toBe(1)
+    expect(table.has(4)).toBe(false)
+    expect(table.get(7)?.id).toBe(7)
+    expect(table.get(SERVER_OBJECT_ID_BASE + 3)?.id).toBe(SERVER_OBJECT_ID_BASE + 3)
+  })
+
+  it('does not allocate a slot for every id below a far out id', () => {
+    // given
+    const table = new WlObjectTable()
+    table.set(new WlObject(1))
+    table.set(new WlObject(3))
+
+    // when
+    table.set(new WlObject(0x7fffffff))
+    table.set(new WlObject(2))
+
+    // then
+    expect(table.get(0x7fffffff)?.id).toBe(0x7fffffff)
+    expect(table.values().map(wlObject => wlObject.id)).toEqual([1, 2, 3, 0x7fffffff])
+    table.delete(0x7fffffff)
+    expect(table.has(0x7fffffff)).toBe(false)
+  })
+})
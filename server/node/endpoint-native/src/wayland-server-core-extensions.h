@@ -61,3 +61,25 @@ wl_resource_destroy_silently(struct wl_resource *resource);
 
 void
 wl_get_server_object_ids_batch(struct wl_client *client, uint32_t *ids, uint32_t amount);
+
+void
+wl_shm_pool_begin_access(struct wl_shm_pool *pool);
+
+int
+wl_shm_pool_end_access(struct wl_shm_pool *pool);
+
+int
+wl_shm_buffer_end_access_checked(struct wl_shm_buffer *buffer);
+
+struct wl_shm_stats {
+    uint64_t pools_created;
+    uint64_t bytes_prefaulted;
+    uint64_t resizes_in_place;
+    uint64_t resizes_moved;
+    uint64_t accesses;
+    uint64_t access_page_faults;
+    uint64_t sigbus_faults;
+};
+
+void
+wl_shm_get_stats(struct wl_shm_stats *stats);
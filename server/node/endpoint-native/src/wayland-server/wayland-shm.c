@@ -36,6 +36,9 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
 #include <unistd.h>
 #include <assert.h>
 #include <signal.h>
@@ -44,6 +47,7 @@
 #include "wayland-util.h"
 #include "wayland-private.h"
 #include "wayland-server.h"
+#include "../wayland-server-core-extensions.h"
 
 /* This once_t is used to synchronize installing the SIGBUS handler
  * and creating the TLS key. This will be done in the first call
@@ -51,6 +55,29 @@
 static pthread_once_t wl_shm_sigbus_once = PTHREAD_ONCE_INIT;
 static pthread_key_t wl_shm_sigbus_data_key;
 static struct sigaction wl_shm_old_sigbus_action;
+/* sysconf is not async-signal-safe, so the page size is looked up once
+ * when the handler is installed */
+static uintptr_t wl_shm_page_size;
+
+/* Pools that are being accessed by any thread. Threads that were not the
+ * one calling wl_shm_buffer_begin_access, eg. helper threads that work on
+ * part of a buffer, have no thread local sigbus data. Their faults are
+ * matched against these pools instead. A pool appears once for each
+ * thread that is accessing it. */
+#define WL_SHM_MAX_ACTIVE_POOLS 64
+static struct wl_shm_pool *wl_shm_active_pools[WL_SHM_MAX_ACTIVE_POOLS];
+
+/* Pools of at least this size are assumed to hold frames and have their
+ * pages faulted in when they are mapped, instead of on first access which
+ * is typically done by an encoder thread */
+#define WL_SHM_PREFAULT_MIN_SIZE (256 * 1024)
+/* Virtual address space reserved for a pool so it can grow in place. A
+ * pool gets at least twice its initial size */
+#define WL_SHM_RESERVE_MIN_SIZE (64 * 1024 * 1024)
+#define WL_SHM_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/* updated with atomic adds as accesses can happen on any thread */
+static struct wl_shm_stats wl_shm_stats;
 
 struct wl_shm_pool {
 	struct wl_resource *resource;
@@ -59,6 +86,20 @@ struct wl_shm_pool {
 	char *data;
 	int32_t size;
 	int32_t new_size;
+	/* Kept open so growing the pool can map the new part of the file
+	 * in place */
+	int fd;
+	/* Size of the address range that starts at data. Only the first
+	 * size bytes map the file, the rest is reserved for growth. */
+	size_t reserved_size;
+	/* The file is shmem, which can be backed by transparent
+	 * hugepages */
+	bool hugepages;
+	/* Set by the SIGBUS handler of any thread once part of the pool
+	 * was replaced by the fallback mapping. Other threads reading the
+	 * same pool would see the zeroed pages without faulting
+	 * themselves, so every access after that is reported as failed. */
+	int faulted;
 };
 
 struct wl_shm_buffer {
@@ -74,25 +115,121 @@ struct wl_shm_sigbus_data {
 	struct wl_shm_pool *current_pool;
 	int access_count;
 	int fallback_mapping_used;
+	/* page faults of this thread when the outermost access began */
+	long page_faults;
+	/* index in wl_shm_active_pools or -1 if it was full */
+	int active_slot;
 };
 
+static size_t
+round_up(size_t size, size_t alignment)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static size_t
+reserve_size(int32_t size)
+{
+	size_t reserved = (size_t) size * 2;
+
+	if (reserved < WL_SHM_RESERVE_MIN_SIZE)
+		reserved = WL_SHM_RESERVE_MIN_SIZE;
+
+	return round_up(reserved, WL_SHM_HUGEPAGE_SIZE);
+}
+
+/* Reserves an inaccessible range of address space that is aligned to
+ * hugepages, so transparent hugepages can be used from its start. */
+static char *
+reserve_range(size_t size)
+{
+	size_t padded_size = size + WL_SHM_HUGEPAGE_SIZE;
+	char *padded, *aligned;
+
+	padded = mmap(NULL, padded_size, PROT_NONE,
+		      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (padded == MAP_FAILED)
+		return NULL;
+
+	aligned = (char *) round_up((uintptr_t) padded, WL_SHM_HUGEPAGE_SIZE);
+	if (aligned > padded)
+		munmap(padded, aligned - padded);
+	munmap(aligned + size, padded + padded_size - (aligned + size));
+
+	return aligned;
+}
+
+/* Maps part of the pool's file over its reserved range. The offset must
+ * be page aligned. */
+static int
+map_pool_range(struct wl_shm_pool *pool, size_t offset, size_t size)
+{
+	int flags = MAP_SHARED | MAP_FIXED;
+
+	if (size >= WL_SHM_PREFAULT_MIN_SIZE)
+		flags |= MAP_POPULATE;
+
+	if (mmap(pool->data + offset, size, PROT_READ | PROT_WRITE,
+		 flags, pool->fd, offset) == MAP_FAILED)
+		return -1;
+
+	if (pool->hugepages)
+		madvise(pool->data + offset, size, MADV_HUGEPAGE);
+
+	if (flags & MAP_POPULATE)
+		__atomic_add_fetch(&wl_shm_stats.bytes_prefaulted, size,
+				   __ATOMIC_RELAXED);
+
+	return 0;
+}
+
 static void
 shm_pool_finish_resize(struct wl_shm_pool *pool)
 {
-	void *data;
+	size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+	size_t mapped_size = round_up(pool->size, page_size);
+	size_t new_mapped_size = round_up(pool->new_size, page_size);
+	size_t old_reserved_size;
+	char *old_data;
 
 	if (pool->size == pool->new_size)
 		return;
 
-	data = mremap(pool->data, pool->size, pool->new_size, MREMAP_MAYMOVE);
-	if (data == MAP_FAILED) {
+	if (new_mapped_size <= pool->reserved_size) {
+		if (new_mapped_size > mapped_size &&
+		    map_pool_range(pool, mapped_size,
+				   new_mapped_size - mapped_size) < 0) {
+			wl_resource_post_error(pool->resource,
+					       WL_SHM_ERROR_INVALID_FD,
+					       "failed mmap");
+			return;
+		}
+
+		__atomic_add_fetch(&wl_shm_stats.resizes_in_place, 1,
+				   __ATOMIC_RELAXED);
+		pool->size = pool->new_size;
+		return;
+	}
+
+	/* Outgrew the reserved range, move to a larger one */
+	old_data = pool->data;
+	old_reserved_size = pool->reserved_size;
+	pool->reserved_size = reserve_size(pool->new_size);
+	pool->data = reserve_range(pool->reserved_size);
+	if (pool->data == NULL ||
+	    map_pool_range(pool, 0, new_mapped_size) < 0) {
+		if (pool->data)
+			munmap(pool->data, pool->reserved_size);
+		pool->data = old_data;
+		pool->reserved_size = old_reserved_size;
 		wl_resource_post_error(pool->resource,
 				       WL_SHM_ERROR_INVALID_FD,
-				       "failed mremap");
+				       "failed mmap");
 		return;
 	}
+	munmap(old_data, old_reserved_size);
 
-	pool->data = data;
+	__atomic_add_fetch(&wl_shm_stats.resizes_moved, 1, __ATOMIC_RELAXED);
 	pool->size = pool->new_size;
 }
 
@@ -110,7 +247,8 @@ shm_pool_unref(struct wl_shm_pool *pool, bool external)
 	if (pool->internal_refcount + pool->external_refcount)
 		return;
 
-	munmap(pool->data, pool->size);
+	munmap(pool->data, pool->reserved_size);
+	close(pool->fd);
 	free(pool);
 }
 
@@ -258,6 +396,7 @@ shm_create_pool(struct wl_client *client, struct wl_resource *resource,
 		uint32_t id, int fd, int32_t size)
 {
 	struct wl_shm_pool *pool;
+	struct statfs fs;
 
 	if (size <= 0) {
 		wl_resource_post_error(resource,
@@ -276,24 +415,31 @@ shm_create_pool(struct wl_client *client, struct wl_resource *resource,
 	pool->external_refcount = 0;
 	pool->size = size;
 	pool->new_size = size;
-	pool->data = mmap(NULL, size,
-			  PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-	if (pool->data == MAP_FAILED) {
+	pool->faulted = 0;
+	pool->fd = fd;
+	pool->hugepages = fstatfs(fd, &fs) == 0 && fs.f_type == TMPFS_MAGIC;
+	pool->reserved_size = reserve_size(size);
+	pool->data = reserve_range(pool->reserved_size);
+	if (pool->data == NULL) {
 		wl_resource_post_error(resource,
 				       WL_SHM_ERROR_INVALID_FD,
 				       "failed mmap fd %d: %m", fd);
 		goto err_free;
 	}
-	close(fd);
+	if (map_pool_range(pool, 0, size) < 0) {
+		wl_resource_post_error(resource,
+				       WL_SHM_ERROR_INVALID_FD,
+				       "failed mmap fd %d: %m", fd);
+		goto err_unmap;
+	}
 
 	pool->resource =
 		wl_resource_create(client, &wl_shm_pool_interface, 1, id);
 	if (!pool->resource) {
 		wl_client_post_no_memory(client);
-		munmap(pool->data, pool->size);
-		free(pool);
-		return;
+		goto err_unmap;
 	}
+	__atomic_add_fetch(&wl_shm_stats.pools_created, 1, __ATOMIC_RELAXED);
 
 	wl_resource_set_implementation(pool->resource,
 				       &shm_pool_interface,
@@ -301,6 +447,8 @@ shm_create_pool(struct wl_client *client, struct wl_resource *resource,
 
 	return;
 
+err_unmap:
+	munmap(pool->data, pool->reserved_size);
 err_free:
 	free(pool);
 err_close:
@@ -468,34 +616,84 @@ reraise_sigbus(void)
 	raise(SIGBUS);
 }
 
+static bool
+pool_contains(struct wl_shm_pool *pool, void *address)
+{
+	return (char *) address >= pool->data &&
+	       (char *) address < pool->data + pool->size;
+}
+
+/* Only reads the table, so it is safe to use from the signal handler. A
+ * pool stays in the table until the access that added it ends, which is
+ * after any helper threads reading it are done. */
+static struct wl_shm_pool *
+find_active_pool(void *address)
+{
+	struct wl_shm_pool *pool;
+	int i;
+
+	for (i = 0; i < WL_SHM_MAX_ACTIVE_POOLS; i++) {
+		pool = __atomic_load_n(&wl_shm_active_pools[i],
+				       __ATOMIC_ACQUIRE);
+		if (pool && pool_contains(pool, address))
+			return pool;
+	}
+
+	return NULL;
+}
+
+static int
+add_active_pool(struct wl_shm_pool *pool)
+{
+	struct wl_shm_pool *expected;
+	int i;
+
+	for (i = 0; i < WL_SHM_MAX_ACTIVE_POOLS; i++) {
+		expected = NULL;
+		if (__atomic_compare_exchange_n(&wl_shm_active_pools[i],
+						&expected, pool, false,
+						__ATOMIC_ACQ_REL,
+						__ATOMIC_RELAXED))
+			return i;
+	}
+
+	/* Only faults of the accessing thread itself are caught then */
+	return -1;
+}
+
 static void
 sigbus_handler(int signum, siginfo_t *info, void *context)
 {
 	struct wl_shm_sigbus_data *sigbus_data =
 		pthread_getspecific(wl_shm_sigbus_data_key);
 	struct wl_shm_pool *pool;
+	char *fault_page;
 
-	if (sigbus_data == NULL) {
-		reraise_sigbus();
-		return;
-	}
+	pool = sigbus_data ? sigbus_data->current_pool : NULL;
+	if (pool == NULL || !pool_contains(pool, info->si_addr))
+		pool = find_active_pool(info->si_addr);
 
-	pool = sigbus_data->current_pool;
-
-	/* If the offending address is outside the mapped space for
-	 * the pool then the error is a real problem so we'll reraise
-	 * the signal */
-	if (pool == NULL ||
-	    (char *) info->si_addr < pool->data ||
-	    (char *) info->si_addr >= pool->data + pool->size) {
+	/* If the offending address is outside the mapped space of the
+	 * pools being accessed then the error is a real problem so we'll
+	 * reraise the signal */
+	if (pool == NULL) {
 		reraise_sigbus();
 		return;
 	}
 
-	sigbus_data->fallback_mapping_used = 1;
-
-	/* This should replace the previous mapping */
-	if (mmap(pool->data, pool->size,
+	if (sigbus_data && sigbus_data->current_pool == pool)
+		sigbus_data->fallback_mapping_used = 1;
+	__atomic_store_n(&pool->faulted, 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&wl_shm_stats.sigbus_faults, 1, __ATOMIC_RELAXED);
+
+	/* The file was truncated somewhere before the faulting page, so
+	 * everything from that page on is past its end. Only that range
+	 * is replaced, other threads can keep reading the pages before it
+	 * as they were. Concurrent faults in the same pool replace an
+	 * anonymous range with another one, which is harmless. */
+	fault_page = (char *) ((uintptr_t) info->si_addr &
+			       ~(wl_shm_page_size - 1));
+	if (mmap(fault_page, pool->data + pool->size - fault_page,
 		 PROT_READ | PROT_WRITE,
 		 MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS,
 		 0, 0) == (void *) -1) {
@@ -522,11 +720,84 @@ init_sigbus_data_key(void)
 
 	sigemptyset(&new_action.sa_mask);
 
+	wl_shm_page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+
 	sigaction(SIGBUS, &new_action, &wl_shm_old_sigbus_action);
 
 	pthread_key_create(&wl_shm_sigbus_data_key, destroy_sigbus_data);
 }
 
+static long
+thread_page_faults(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_THREAD, &usage) < 0)
+		return 0;
+
+	return usage.ru_minflt + usage.ru_majflt;
+}
+
+static void
+pool_begin_access(struct wl_shm_pool *pool)
+{
+	struct wl_shm_sigbus_data *sigbus_data;
+
+	pthread_once(&wl_shm_sigbus_once, init_sigbus_data_key);
+
+	sigbus_data = pthread_getspecific(wl_shm_sigbus_data_key);
+	if (sigbus_data == NULL) {
+		sigbus_data = zalloc(sizeof *sigbus_data);
+		if (sigbus_data == NULL)
+			return;
+
+		pthread_setspecific(wl_shm_sigbus_data_key, sigbus_data);
+	}
+
+	assert(sigbus_data->current_pool == NULL ||
+	       sigbus_data->current_pool == pool);
+
+	if (sigbus_data->access_count == 0) {
+		sigbus_data->active_slot = add_active_pool(pool);
+		sigbus_data->page_faults = thread_page_faults();
+	}
+
+	sigbus_data->current_pool = pool;
+	sigbus_data->access_count++;
+}
+
+/* Returns 1 if the outermost access of the pool may have read from the
+ * fallback mapping, whether it was installed by this thread or by another
+ * one. */
+static int
+pool_end_access(void)
+{
+	struct wl_shm_sigbus_data *sigbus_data =
+		pthread_getspecific(wl_shm_sigbus_data_key);
+	int fallback_mapping_used = 0;
+
+	assert(sigbus_data && sigbus_data->access_count >= 1);
+
+	if (--sigbus_data->access_count == 0) {
+		fallback_mapping_used = sigbus_data->fallback_mapping_used ||
+			__atomic_load_n(&sigbus_data->current_pool->faulted,
+					__ATOMIC_ACQUIRE);
+		sigbus_data->fallback_mapping_used = 0;
+		sigbus_data->current_pool = NULL;
+		if (sigbus_data->active_slot >= 0)
+			__atomic_store_n(&wl_shm_active_pools[sigbus_data->active_slot],
+					 NULL, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&wl_shm_stats.accesses, 1,
+				   __ATOMIC_RELAXED);
+		__atomic_add_fetch(&wl_shm_stats.access_page_faults,
+				   thread_page_faults() -
+				   sigbus_data->page_faults,
+				   __ATOMIC_RELAXED);
+	}
+
+	return fallback_mapping_used;
+}
+
 /** Mark that the given SHM buffer is about to be accessed
  *
  * \param buffer The SHM buffer
@@ -561,30 +832,17 @@ init_sigbus_data_key(void)
  * is allowed to simultaneously access different buffers or the same
  * buffer from multiple threads.
  *
+ * Once a SIGBUS was handled for any part of a pool, every access of that
+ * pool, from any thread, is reported as failed. Other threads could
+ * otherwise silently read the zeroed pages that replaced the truncated
+ * part of the file.
+ *
  * \memberof wl_shm_buffer
  */
 WL_EXPORT void
 wl_shm_buffer_begin_access(struct wl_shm_buffer *buffer)
 {
-	struct wl_shm_pool *pool = buffer->pool;
-	struct wl_shm_sigbus_data *sigbus_data;
-
-	pthread_once(&wl_shm_sigbus_once, init_sigbus_data_key);
-
-	sigbus_data = pthread_getspecific(wl_shm_sigbus_data_key);
-	if (sigbus_data == NULL) {
-		sigbus_data = zalloc(sizeof *sigbus_data);
-		if (sigbus_data == NULL)
-			return;
-
-		pthread_setspecific(wl_shm_sigbus_data_key, sigbus_data);
-	}
-
-	assert(sigbus_data->current_pool == NULL ||
-	       sigbus_data->current_pool == pool);
-
-	sigbus_data->current_pool = pool;
-	sigbus_data->access_count++;
+	pool_begin_access(buffer->pool);
 }
 
 /** Ends the access to a buffer started by wl_shm_buffer_begin_access
@@ -601,21 +859,53 @@ wl_shm_buffer_begin_access(struct wl_shm_buffer *buffer)
 WL_EXPORT void
 wl_shm_buffer_end_access(struct wl_shm_buffer *buffer)
 {
-	struct wl_shm_sigbus_data *sigbus_data =
-		pthread_getspecific(wl_shm_sigbus_data_key);
+	wl_shm_buffer_end_access_checked(buffer);
+}
 
-	assert(sigbus_data && sigbus_data->access_count >= 1);
+/** Same as wl_shm_buffer_end_access but tells if the access failed
+ *
+ * \param buffer The SHM buffer
+ * \return -1 if a SIGBUS was generated while the buffer was accessed, in
+ * which case whatever was read from it can not be used. The client is
+ * sent an error.
+ */
+int
+wl_shm_buffer_end_access_checked(struct wl_shm_buffer *buffer)
+{
+	if (pool_end_access()) {
+		wl_resource_post_error(buffer->resource,
+				       WL_SHM_ERROR_INVALID_FD,
+				       "error accessing SHM buffer");
+		return -1;
+	}
+	return 0;
+}
 
-	if (--sigbus_data->access_count == 0) {
-		if (sigbus_data->fallback_mapping_used) {
-			wl_resource_post_error(buffer->resource,
-					       WL_SHM_ERROR_INVALID_FD,
-					       "error accessing SHM buffer");
-			sigbus_data->fallback_mapping_used = 0;
-		}
+/** Mark that a pool is about to be accessed
+ *
+ * \param pool A pool reference taken with wl_shm_buffer_ref_pool
+ *
+ * Same as wl_shm_buffer_begin_access but for a pool that was referenced
+ * with wl_shm_buffer_ref_pool. The buffer itself may be gone by the time
+ * the pool is accessed, eg. when reading it from a worker thread.
+ */
+void
+wl_shm_pool_begin_access(struct wl_shm_pool *pool)
+{
+	pool_begin_access(pool);
+}
 
-		sigbus_data->current_pool = NULL;
-	}
+/** Ends the access to a pool started by wl_shm_pool_begin_access
+ *
+ * \param pool The pool
+ * \return -1 if the client truncated the pool while it was accessed. No
+ * error is posted to the client, that is left to the caller as this may
+ * be called from any thread.
+ */
+int
+wl_shm_pool_end_access(struct wl_shm_pool *pool)
+{
+	return pool_end_access() ? -1 : 0;
 }
 
 /** \cond */ /* Deprecated functions below. */
@@ -634,3 +924,30 @@ wl_shm_buffer_create(struct wl_client *client,
  * code here, add it before the comment above that states:
  * Deprecated functions below.
  */
+
+/** Get the counters of all shm pools of the process
+ *
+ * \param stats Receives the counters
+ *
+ * Page faults are those taken by the threads that called
+ * wl_shm_buffer_begin_access or wl_shm_pool_begin_access, between the
+ * outermost begin and end of each access.
+ */
+void
+wl_shm_get_stats(struct wl_shm_stats *stats)
+{
+	stats->pools_created = __atomic_load_n(&wl_shm_stats.pools_created,
+					       __ATOMIC_RELAXED);
+	stats->bytes_prefaulted = __atomic_load_n(&wl_shm_stats.bytes_prefaulted,
+						  __ATOMIC_RELAXED);
+	stats->resizes_in_place = __atomic_load_n(&wl_shm_stats.resizes_in_place,
+						  __ATOMIC_RELAXED);
+	stats->resizes_moved = __atomic_load_n(&wl_shm_stats.resizes_moved,
+					       __ATOMIC_RELAXED);
+	stats->accesses = __atomic_load_n(&wl_shm_stats.accesses,
+					  __ATOMIC_RELAXED);
+	stats->access_page_faults = __atomic_load_n(&wl_shm_stats.access_page_faults,
+						    __ATOMIC_RELAXED);
+	stats->sigbus_faults = __atomic_load_n(&wl_shm_stats.sigbus_faults,
+					       __ATOMIC_RELAXED);
+}
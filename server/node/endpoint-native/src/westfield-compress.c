@@ -0,0 +1,127 @@
+#include <string.h>
+#include "westfield-compress.h"
+
+#define HASH_LOG 12
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+// an LZ4 block ends with at least 5 literals and the last match starts at least 12 bytes before the end
+#define LAST_LITERALS 5
+#define MF_LIMIT 12
+// skip ahead faster on data that does not compress
+#define SKIP_TRIGGER 6
+
+static inline uint32_t
+read32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t
+hash32(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static inline uint8_t *
+write_length(uint8_t *op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t) length;
+    return op;
+}
+
+static uint8_t *
+write_sequence(uint8_t *op, const uint8_t *oend, const uint8_t *literals, size_t literal_length, size_t offset,
+               size_t match_length) {
+    // token + literal length + literals + offset + match length, worst case
+    const size_t needed = 1 + (literal_length / 255 + 1) + literal_length + 2 + (match_length / 255 + 1);
+    uint8_t *token;
+
+    if ((size_t) (oend - op) < needed) {
+        return NULL;
+    }
+
+    token = op++;
+    *token = (uint8_t) ((literal_length >= 15 ? 15 : literal_length) << 4);
+    if (literal_length >= 15) {
+        op = write_length(op, literal_length - 15);
+    }
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+
+    if (offset) {
+        *token |= (uint8_t) (match_length >= 15 ? 15 : match_length);
+        *op++ = (uint8_t) (offset & 0xff);
+        *op++ = (uint8_t) (offset >> 8);
+        if (match_length >= 15) {
+            op = write_length(op, match_length - 15);
+        }
+    }
+
+    return op;
+}
+
+size_t
+westfield_compress_block(const uint8_t *src, size_t src_size, uint8_t *dst, size_t dst_capacity) {
+    uint32_t table[1 << HASH_LOG];
+    const uint8_t *ip = src, *anchor = src;
+    const uint8_t *const iend = src + src_size;
+    uint8_t *op = dst + 4;
+    const uint8_t *const oend = dst + dst_capacity;
+    uint32_t misses = 0;
+
+    if (dst_capacity < 4 || src_size > UINT32_MAX) {
+        return 0;
+    }
+    dst[0] = (uint8_t) src_size;
+    dst[1] = (uint8_t) (src_size >> 8);
+    dst[2] = (uint8_t) (src_size >> 16);
+    dst[3] = (uint8_t) (src_size >> 24);
+
+    if (src_size > MF_LIMIT) {
+        const uint8_t *const mflimit = iend - MF_LIMIT;
+        const uint8_t *const matchlimit = iend - LAST_LITERALS;
+
+        memset(table, 0, sizeof(table));
+        while (ip < mflimit) {
+            const uint32_t sequence = read32(ip);
+            const uint32_t hash = hash32(sequence);
+            const uint8_t *ref = src + table[hash];
+            const uint8_t *match_end, *ref_end;
+
+            table[hash] = (uint32_t) (ip - src);
+            if (ref >= ip || ip - ref > MAX_OFFSET || read32(ref) != sequence) {
+                ip += 1 + (misses++ >> SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            match_end = ip + MIN_MATCH;
+            ref_end = ref + MIN_MATCH;
+            while (match_end < matchlimit && *match_end == *ref_end) {
+                match_end++;
+                ref_end++;
+            }
+
+            op = write_sequence(op, oend, anchor, (size_t) (ip - anchor), (size_t) (ip - ref),
+                                (size_t) (match_end - ip) - MIN_MATCH);
+            if (op == NULL) {
+                return 0;
+            }
+            ip = match_end;
+            anchor = ip;
+        }
+    }
+
+    op = write_sequence(op, oend, anchor, (size_t) (iend - anchor), 0, 0);
+    if (op == NULL) {
+        return 0;
+    }
+    return (size_t) (op - dst);
+}
@@ -0,0 +1,19 @@
+//
+// LZ4 style block compression of flushed wire message batches.
+//
+
+#ifndef WESTFIELD_COMPRESS_H
+#define WESTFIELD_COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Compresses src into dst as a little endian uint32 holding src_size, followed by an LZ4 block. Returns the amount of
+ * bytes written to dst, or 0 if the result does not fit in dst_capacity. Passing a dst_capacity smaller than src_size
+ * makes the call bail out early on data that does not compress.
+ */
+size_t
+westfield_compress_block(const uint8_t *src, size_t src_size, uint8_t *dst, size_t dst_capacity);
+
+#endif //WESTFIELD_COMPRESS_H
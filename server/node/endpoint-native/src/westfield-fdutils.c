@@ -31,7 +31,9 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <stdio.h>
 
 #include "westfield-fdutils.h"
 
@@ -82,3 +84,27 @@ os_create_anonymous_file(off_t size) {
 
     return fd;
 }
+
+int
+os_reopen_file(int fd, int flags) {
+    char path[32];
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    return open(path, flags | O_CLOEXEC);
+}
+
+int
+os_write_fully(int fd, const void *data, size_t size, off_t offset) {
+    const uint8_t *position = data;
+
+    while (size > 0) {
+        ssize_t written = pwrite(fd, position, size, offset);
+        if (written <= 0) {
+            return -1;
+        }
+        position += written;
+        offset += written;
+        size -= (size_t) written;
+    }
+    return 0;
+}
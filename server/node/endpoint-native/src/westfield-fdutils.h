@@ -2,5 +2,20 @@
 // Created by erik on 10/3/18.
 //
 
+#include <sys/types.h>
+
 int
 os_create_anonymous_file(off_t size);
+
+/*
+ * Opens the file behind fd again, with flags. Unlike dup, the new fd has an open file of its own, so the kernel counts
+ * it as a separate reader or writer of the file.
+ */
+int
+os_reopen_file(int fd, int flags);
+
+/*
+ * Writes all of data at offset. Returns -1 on error.
+ */
+int
+os_write_fully(int fd, const void *data, size_t size, off_t offset);
@@ -0,0 +1,148 @@
+#include <string.h>
+#include "westfield-hash.h"
+
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t
+rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t
+read64(const uint8_t *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t
+read32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t
+round64(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t
+merge_round64(uint64_t acc, uint64_t value) {
+    acc ^= round64(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+static inline void
+consume_stripe(uint64_t lanes[4], const uint8_t *stripe) {
+    lanes[0] = round64(lanes[0], read64(stripe));
+    lanes[1] = round64(lanes[1], read64(stripe + 8));
+    lanes[2] = round64(lanes[2], read64(stripe + 16));
+    lanes[3] = round64(lanes[3], read64(stripe + 24));
+}
+
+void
+westfield_hash_init(struct westfield_hash_state *state, uint64_t seed) {
+    state->lanes[0] = seed + PRIME64_1 + PRIME64_2;
+    state->lanes[1] = seed + PRIME64_2;
+    state->lanes[2] = seed;
+    state->lanes[3] = seed - PRIME64_1;
+    state->pending_size = 0;
+    state->total_size = 0;
+    state->seed = seed;
+}
+
+void
+westfield_hash_update(struct westfield_hash_state *state, const uint8_t *data, size_t size) {
+    const uint8_t *const end = data + size;
+
+    state->total_size += size;
+
+    if (state->pending_size + size < 32) {
+        memcpy(state->pending + state->pending_size, data, size);
+        state->pending_size += size;
+        return;
+    }
+
+    if (state->pending_size) {
+        const size_t fill = 32 - state->pending_size;
+        memcpy(state->pending + state->pending_size, data, fill);
+        consume_stripe(state->lanes, state->pending);
+        data += fill;
+        state->pending_size = 0;
+    }
+
+    while (end - data >= 32) {
+        consume_stripe(state->lanes, data);
+        data += 32;
+    }
+
+    state->pending_size = (size_t) (end - data);
+    memcpy(state->pending, data, state->pending_size);
+}
+
+uint64_t
+westfield_hash_digest(const struct westfield_hash_state *state) {
+    const uint8_t *p = state->pending;
+    const uint8_t *const end = p + state->pending_size;
+    uint64_t hash;
+
+    if (state->total_size >= 32) {
+        hash = rotl64(state->lanes[0], 1) + rotl64(state->lanes[1], 7) + rotl64(state->lanes[2], 12) +
+               rotl64(state->lanes[3], 18);
+        hash = merge_round64(hash, state->lanes[0]);
+        hash = merge_round64(hash, state->lanes[1]);
+        hash = merge_round64(hash, state->lanes[2]);
+        hash = merge_round64(hash, state->lanes[3]);
+    } else {
+        hash = state->seed + PRIME64_5;
+    }
+    hash += state->total_size;
+
+    while (end - p >= 8) {
+        hash ^= round64(0, read64(p));
+        hash = rotl64(hash, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        hash ^= (uint64_t) read32(p) * PRIME64_1;
+        hash = rotl64(hash, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        hash ^= (*p) * PRIME64_5;
+        hash = rotl64(hash, 11) * PRIME64_1;
+        p++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint64_t
+westfield_hash_pixels(const uint8_t *data, int32_t width, int32_t height, int32_t stride, uint32_t format,
+                      size_t row_size) {
+    struct westfield_hash_state state;
+    const uint64_t seed = ((uint64_t) (uint32_t) width << 32 | (uint32_t) height) ^ ((uint64_t) format << 48);
+
+    westfield_hash_init(&state, seed);
+    if (row_size == (size_t) stride) {
+        // no padding, hash all rows in one go
+        westfield_hash_update(&state, data, row_size * height);
+    } else {
+        for (int32_t row = 0; row < height; row++) {
+            westfield_hash_update(&state, data + (size_t) row * stride, row_size);
+        }
+    }
+    return westfield_hash_digest(&state);
+}
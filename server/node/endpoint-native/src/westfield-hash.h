@@ -0,0 +1,37 @@
+//
+// xxHash64 style content hashing of shm buffers.
+//
+
+#ifndef WESTFIELD_HASH_H
+#define WESTFIELD_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct westfield_hash_state {
+    // four independent lanes so consecutive stripes can be processed in parallel
+    uint64_t lanes[4];
+    uint8_t pending[32];
+    size_t pending_size;
+    uint64_t total_size;
+    uint64_t seed;
+};
+
+void
+westfield_hash_init(struct westfield_hash_state *state, uint64_t seed);
+
+void
+westfield_hash_update(struct westfield_hash_state *state, const uint8_t *data, size_t size);
+
+uint64_t
+westfield_hash_digest(const struct westfield_hash_state *state);
+
+/*
+ * Hashes the first row_size bytes of each row of a pixel buffer, ie. the padding at the end of each stride is skipped.
+ * The size and format are part of the hash so equal bytes with a different layout do not collide.
+ */
+uint64_t
+westfield_hash_pixels(const uint8_t *data, int32_t width, int32_t height, int32_t stride, uint32_t format,
+                      size_t row_size);
+
+#endif //WESTFIELD_HASH_H
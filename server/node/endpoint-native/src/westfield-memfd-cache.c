@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "westfield-fdutils.h"
+#include "westfield-hash.h"
+#include "westfield-memfd-cache.h"
+
+#define ALL_SEALS (F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+struct cache_entry {
+    uint64_t hash;
+    size_t size;
+    // a read only open file of its own, clients get one each as well
+    int fd;
+    // to tell blobs with the same hash apart, NULL if the blob is empty
+    const uint8_t *data;
+    uint64_t last_used;
+};
+
+struct westfield_memfd_cache {
+    struct cache_entry *entries;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t max_files;
+    size_t max_bytes;
+    size_t bytes;
+    uint64_t clock;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+/*
+ * A write lease can only be taken on a file that is not open anywhere else. Open files that were passed on to clients
+ * count until the clients have closed and unmapped them, so this tells us if any client still uses the blob.
+ */
+static bool
+entry_unused(struct cache_entry *entry) {
+    if (fcntl(entry->fd, F_SETLEASE, F_WRLCK) < 0) {
+        return false;
+    }
+    fcntl(entry->fd, F_SETLEASE, F_UNLCK);
+    return true;
+}
+
+static void
+entry_release(struct cache_entry *entry) {
+    if (entry->data) {
+        munmap((void *) entry->data, entry->size);
+    }
+    close(entry->fd);
+}
+
+static int
+entry_init(struct cache_entry *entry, uint64_t hash, const void *contents, size_t size) {
+    int fd = memfd_create("westfield-sealed", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    void *data = NULL;
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (os_write_fully(fd, contents, size, 0) < 0 || fcntl(fd, F_ADD_SEALS, ALL_SEALS) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    // the memfd itself is writable, keep a read only file instead so it can be told apart from those of clients
+    entry->fd = os_reopen_file(fd, O_RDONLY);
+    close(fd);
+    if (entry->fd < 0) {
+        return -1;
+    }
+    if (size > 0) {
+        data = mmap(NULL, size, PROT_READ, MAP_SHARED, entry->fd, 0);
+        if (data == MAP_FAILED) {
+            close(entry->fd);
+            return -1;
+        }
+    }
+
+    entry->hash = hash;
+    entry->size = size;
+    entry->data = data;
+    return 0;
+}
+
+static void
+evict(struct westfield_memfd_cache *cache) {
+    while (cache->count > cache->max_files || cache->bytes > cache->max_bytes) {
+        struct cache_entry *oldest = NULL;
+
+        for (uint32_t i = 0; i < cache->count; i++) {
+            struct cache_entry *entry = &cache->entries[i];
+            if ((oldest == NULL || entry->last_used < oldest->last_used) && entry_unused(entry)) {
+                oldest = entry;
+            }
+        }
+        if (oldest == NULL) {
+            return;
+        }
+
+        cache->bytes -= oldest->size;
+        cache->evictions++;
+        entry_release(oldest);
+        *oldest = cache->entries[--cache->count];
+    }
+}
+
+struct westfield_memfd_cache *
+westfield_memfd_cache_create(uint32_t max_files, size_t max_bytes) {
+    struct westfield_memfd_cache *cache = calloc(1, sizeof(struct westfield_memfd_cache));
+
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->max_files = max_files;
+    cache->max_bytes = max_bytes;
+    return cache;
+}
+
+void
+westfield_memfd_cache_destroy(struct westfield_memfd_cache *cache) {
+    for (uint32_t i = 0; i < cache->count; i++) {
+        entry_release(&cache->entries[i]);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+int
+westfield_memfd_cache_get(struct westfield_memfd_cache *cache, const void *contents, size_t size) {
+    struct westfield_hash_state hash_state;
+    struct cache_entry *entry;
+    uint64_t hash;
+    int fd;
+
+    westfield_hash_init(&hash_state, 0);
+    westfield_hash_update(&hash_state, contents, size);
+    hash = westfield_hash_digest(&hash_state);
+
+    for (uint32_t i = 0; i < cache->count; i++) {
+        entry = &cache->entries[i];
+        if (entry->hash == hash && entry->size == size && (size == 0 || memcmp(entry->data, contents, size) == 0)) {
+            fd = os_reopen_file(entry->fd, O_RDONLY);
+            if (fd >= 0) {
+                entry->last_used = ++cache->clock;
+                cache->hits++;
+            }
+            return fd;
+        }
+    }
+
+    if (cache->count == cache->capacity) {
+        const uint32_t capacity = cache->capacity ? cache->capacity * 2 : 8;
+        struct cache_entry *entries = realloc(cache->entries, capacity * sizeof(struct cache_entry));
+        if (entries == NULL) {
+            return -1;
+        }
+        cache->entries = entries;
+        cache->capacity = capacity;
+    }
+    entry = &cache->entries[cache->count];
+    if (entry_init(entry, hash, contents, size) < 0) {
+        return -1;
+    }
+    fd = os_reopen_file(entry->fd, O_RDONLY);
+    if (fd < 0) {
+        entry_release(entry);
+        return -1;
+    }
+    entry->last_used = ++cache->clock;
+    cache->count++;
+    cache->bytes += size;
+    cache->misses++;
+
+    // the new blob is in use by the fd we return, so it is never the one that is evicted
+    evict(cache);
+    return fd;
+}
+
+void
+westfield_memfd_cache_get_stats(struct westfield_memfd_cache *cache, struct westfield_memfd_cache_stats *stats) {
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->files = cache->count;
+    stats->bytes = cache->bytes;
+}
@@ -0,0 +1,43 @@
+//
+// Sealed shared memory files for blobs that are sent to many clients, eg. the keymap.
+//
+
+#ifndef WESTFIELD_MEMFD_CACHE_H
+#define WESTFIELD_MEMFD_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct westfield_memfd_cache;
+
+struct westfield_memfd_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    // unique blobs in the cache
+    uint32_t files;
+    uint64_t bytes;
+};
+
+/*
+ * Blobs that no client uses anymore are evicted, least recently used first, once the cache holds more than max_files
+ * files or max_bytes bytes. Blobs that are still in use are never evicted, so both limits can be exceeded.
+ */
+struct westfield_memfd_cache *
+westfield_memfd_cache_create(uint32_t max_files, size_t max_bytes);
+
+void
+westfield_memfd_cache_destroy(struct westfield_memfd_cache *cache);
+
+/*
+ * Returns a new read only fd of a file that holds exactly size bytes of contents. All callers that ask for the same
+ * contents get the same file, which is sealed so no client can change or resize it. The caller owns the returned fd
+ * and normally passes it on to a client. Returns -1 on error, eg. if the kernel does not support sealing.
+ */
+int
+westfield_memfd_cache_get(struct westfield_memfd_cache *cache, const void *contents, size_t size);
+
+void
+westfield_memfd_cache_get_stats(struct westfield_memfd_cache *cache, struct westfield_memfd_cache_stats *stats);
+
+#endif //WESTFIELD_MEMFD_CACHE_H
@@ -0,0 +1,191 @@
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "westfield-fdutils.h"
+#include "westfield-memfd-pool.h"
+
+// size classes are powers of two from a page up to 16 MiB, larger files are not pooled
+#define MIN_CLASS_SHIFT 12
+#define MAX_CLASS_SHIFT 24
+#define CLASS_COUNT (MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1)
+#define MAX_FILES_PER_CLASS 8
+#define PAGE_SIZE_MIN (1u << MIN_CLASS_SHIFT)
+
+struct pool_file {
+    // only used by the pool itself, clients get their own open file of it
+    int fd;
+    // bytes at the start of the file that may still hold data of a previous use
+    size_t dirty_size;
+};
+
+struct size_class {
+    struct pool_file files[MAX_FILES_PER_CLASS];
+    int count;
+};
+
+struct westfield_memfd_pool {
+    struct size_class classes[CLASS_COUNT];
+    // false if we can't find out when clients are done with a file, files are then never reused
+    bool reusable;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+static int
+size_class_index(size_t size) {
+    for (int shift = MIN_CLASS_SHIFT; shift <= MAX_CLASS_SHIFT; shift++) {
+        if (size <= ((size_t) 1 << shift)) {
+            return shift - MIN_CLASS_SHIFT;
+        }
+    }
+    return -1;
+}
+
+static int
+create_file(size_t size) {
+    int fd = memfd_create("westfield-shared", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, (off_t) size) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Every fd handed out to a client is an open file of its own that holds write access to the file for as long as the
+ * client keeps it open or mapped. The memfd that the pool keeps does not count as a writer, so a read lease can only be
+ * taken once all clients are done with the file. We drop the lease right away, we only want to know if we can get it.
+ */
+static bool
+file_unused(int fd) {
+    if (fcntl(fd, F_SETLEASE, F_RDLCK) < 0) {
+        return false;
+    }
+    fcntl(fd, F_SETLEASE, F_UNLCK);
+    return true;
+}
+
+static int
+fill_file(struct pool_file *file, const void *contents, size_t size) {
+    if (os_write_fully(file->fd, contents, size, 0) < 0) {
+        if (size > file->dirty_size) {
+            file->dirty_size = size;
+        }
+        return -1;
+    }
+    // clear what is left of the previous contents, this also frees the pages that are no longer needed
+    if (file->dirty_size > size &&
+        fallocate(file->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t) size,
+                  (off_t) (file->dirty_size - size)) < 0) {
+        return -1;
+    }
+    file->dirty_size = size;
+    return 0;
+}
+
+static int
+get_pooled(struct westfield_memfd_pool *pool, struct size_class *size_class, size_t class_size, const void *contents,
+           size_t size) {
+    struct pool_file *file;
+    int fd;
+
+    for (int i = 0; i < size_class->count; i++) {
+        file = &size_class->files[i];
+        if (file_unused(file->fd) && fill_file(file, contents, size) == 0 &&
+            (fd = os_reopen_file(file->fd, O_RDWR)) >= 0) {
+            pool->hits++;
+            return fd;
+        }
+    }
+
+    if (size_class->count == MAX_FILES_PER_CLASS) {
+        return -1;
+    }
+    file = &size_class->files[size_class->count];
+    file->fd = create_file(class_size);
+    file->dirty_size = 0;
+    if (file->fd < 0) {
+        return -1;
+    }
+    if (fill_file(file, contents, size) < 0 || (fd = os_reopen_file(file->fd, O_RDWR)) < 0) {
+        close(file->fd);
+        return -1;
+    }
+    size_class->count++;
+    pool->misses++;
+    return fd;
+}
+
+struct westfield_memfd_pool *
+westfield_memfd_pool_create(void) {
+    struct westfield_memfd_pool *pool = calloc(1, sizeof(struct westfield_memfd_pool));
+    int fd;
+
+    if (pool == NULL) {
+        return NULL;
+    }
+    // leases can be disabled system wide
+    fd = create_file(0);
+    pool->reusable = fd >= 0 && file_unused(fd);
+    if (fd >= 0) {
+        close(fd);
+    }
+    return pool;
+}
+
+void
+westfield_memfd_pool_destroy(struct westfield_memfd_pool *pool) {
+    for (int i = 0; i < CLASS_COUNT; i++) {
+        for (int j = 0; j < pool->classes[i].count; j++) {
+            close(pool->classes[i].files[j].fd);
+        }
+    }
+    free(pool);
+}
+
+int
+westfield_memfd_pool_get(struct westfield_memfd_pool *pool, const void *contents, size_t size) {
+    const int class_index = size_class_index(size);
+    int fd;
+
+    if (pool->reusable && class_index >= 0) {
+        fd = get_pooled(pool, &pool->classes[class_index], (size_t) 1 << (class_index + MIN_CLASS_SHIFT), contents,
+                        size);
+        if (fd >= 0) {
+            return fd;
+        }
+    }
+
+    // not pooled, the fd we return is the only one
+    pool->misses++;
+    fd = create_file(size);
+    if (fd < 0) {
+        fd = os_create_anonymous_file((off_t) size);
+    }
+    if (fd >= 0 && os_write_fully(fd, contents, size, 0) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+void
+westfield_memfd_pool_get_stats(struct westfield_memfd_pool *pool, struct westfield_memfd_pool_stats *stats) {
+    stats->hits = pool->hits;
+    stats->misses = pool->misses;
+    stats->files = 0;
+    stats->resident_bytes = 0;
+    for (int i = 0; i < CLASS_COUNT; i++) {
+        for (int j = 0; j < pool->classes[i].count; j++) {
+            stats->files++;
+            stats->resident_bytes += (pool->classes[i].files[j].dirty_size + PAGE_SIZE_MIN - 1) & ~(PAGE_SIZE_MIN - 1);
+        }
+    }
+}
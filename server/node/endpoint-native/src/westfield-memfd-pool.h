@@ -0,0 +1,44 @@
+//
+// Reusable anonymous shared memory files for data that the compositor hands to clients, eg. keymaps.
+//
+
+#ifndef WESTFIELD_MEMFD_POOL_H
+#define WESTFIELD_MEMFD_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct westfield_memfd_pool;
+
+struct westfield_memfd_pool_stats {
+    // files handed out that were reused from the pool
+    uint64_t hits;
+    // files handed out that had to be created
+    uint64_t misses;
+    // files kept by the pool, whether a client still uses them or not
+    uint32_t files;
+    // memory that backs the kept files
+    uint64_t resident_bytes;
+};
+
+struct westfield_memfd_pool *
+westfield_memfd_pool_create(void);
+
+/*
+ * Closes the files of the pool. Files that clients still use stay alive until the clients close them.
+ */
+void
+westfield_memfd_pool_destroy(struct westfield_memfd_pool *pool);
+
+/*
+ * Returns a new fd of a file that holds size bytes of contents, followed by zeroes. The file is taken from the pool if
+ * one of the right size class is no longer used by any client, or created otherwise. The caller owns the returned fd
+ * and normally passes it on to a client. Returns -1 on error.
+ */
+int
+westfield_memfd_pool_get(struct westfield_memfd_pool *pool, const void *contents, size_t size);
+
+void
+westfield_memfd_pool_get_stats(struct westfield_memfd_pool *pool, struct westfield_memfd_pool_stats *stats);
+
+#endif //WESTFIELD_MEMFD_POOL_H
@@ -8,8 +8,21 @@
 #include "wayland-server-core-extensions.h"
 #include "connection.h"
 #include "westfield-fdutils.h"
+#include "westfield-compress.h"
+#include "westfield-hash.h"
+#include "westfield-memfd-cache.h"
+#include "westfield-memfd-pool.h"
+#include "westfield-scale.h"
+#include "westfield-scroll.h"
+#include "westfield-surface-tracker.h"
+#include "westfield-video.h"
+#include "westfield-yuv.h"
 #include "westfield-xwayland.h"
 
+#define THUMBNAIL_MAX_SIZE 4096
+#define THUMBNAIL_MAX_THREADS 4
+#define I420_MAX_THREADS 4
+
 #define DECLARE_NAPI_METHOD(name, func)                          \
   { name, 0, func, 0, 0, 0, napi_default, 0 }
 
@@ -48,6 +61,78 @@ struct client_destruction_listener {
     napi_ref wire_message_end_cb_ref;
     napi_ref registry_created_cb_ref;
     napi_ref buffer_created_cb_ref;
+    napi_ref surface_commit_cb_ref;
+    struct westfield_surface_tracker *surface_tracker;
+    // asynchronous reads of this client's buffers that are still running, see i420_work
+    struct wl_list pending_buffer_reads;
+};
+
+// Freed when its JS object is garbage collected. Destroying it only frees the encoder.
+struct video_encoder_handle {
+    // NULL once destroyed, or if it could not be created
+    struct westfield_video_encoder *encoder;
+    // only one frame per encoder is encoded at a time
+    bool busy;
+    bool destroyed;
+    // the encoder is only touched on the main thread while it is not encoding, a new bitrate waits until it is done
+    bool bitrate_pending;
+    uint32_t pending_bitrate;
+};
+
+struct scroll_detector_handle {
+    // NULL once destroyed, or if it could not be created
+    struct westfield_scroll_detector *detector;
+};
+
+struct video_encode_work {
+    napi_async_work work;
+    napi_ref callback_ref;
+    // keeps the handle alive while it is being encoded with
+    napi_ref handle_ref;
+    struct video_encoder_handle *handle;
+    uint32_t *pixels;
+    int32_t width;
+    int32_t height;
+    bool force_keyframe;
+    uint8_t *chunk;
+    size_t chunk_size;
+};
+
+// The pixels of a shm buffer as they can be read from a worker thread. The pool is referenced so it is not unmapped or
+// moved while the buffer is being read, even if the client destroys the buffer or the pool in the mean time.
+struct shm_snapshot {
+    struct wl_shm_pool *pool;
+    const uint8_t *data;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    uint32_t format;
+};
+
+struct thumbnail_work {
+    napi_async_work work;
+    napi_ref callback_ref;
+    struct shm_snapshot snapshot;
+    uint32_t *pixels;
+    int32_t width;
+    int32_t height;
+    int result;
+};
+
+struct i420_work {
+    napi_async_work work;
+    napi_ref callback_ref;
+    // the target array buffer, if one was given
+    napi_ref target_ref;
+    struct shm_snapshot snapshot;
+    enum westfield_yuv_matrix matrix;
+    struct westfield_i420_layout layout;
+    uint8_t *planes;
+    int result;
+    // NULL once the client is destroyed
+    struct wl_client *client;
+    uint32_t buffer_id;
+    struct wl_list link;
 };
 
 struct weston_xwayland_callbacks {
@@ -74,6 +159,17 @@ on_display_destroyed(struct wl_listener *listener, void *data) {
 static void
 on_client_destroyed(struct wl_listener *listener, void *data) {
     struct client_destruction_listener *destruction_listener = (struct client_destruction_listener *) listener;
+    struct i420_work *i420_work, *next;
+
+    wl_list_for_each_safe(i420_work, next, &destruction_listener->pending_buffer_reads, link) {
+        i420_work->client = NULL;
+        wl_list_remove(&i420_work->link);
+        wl_list_init(&i420_work->link);
+    }
+    if (destruction_listener->surface_tracker) {
+        westfield_surface_tracker_destroy(destruction_listener->surface_tracker);
+        destruction_listener->surface_tracker = NULL;
+    }
     if (destruction_listener->destroy_cb_ref) {
         struct wl_client *client = data;
         struct display_destruction_listener *display_destruction_listener;
@@ -108,6 +204,18 @@ on_client_destroyed(struct wl_listener *listener, void *data) {
         if (destruction_listener->buffer_created_cb_ref) {
             NAPI_CALL(env, napi_delete_reference(env, destruction_listener->buffer_created_cb_ref))
         }
+        if (destruction_listener->surface_commit_cb_ref) {
+            NAPI_CALL(env, napi_delete_reference(env, destruction_listener->surface_commit_cb_ref))
+        }
+    }
+}
+
+static void
+release_consumed_buffer(struct wl_client *client, uint32_t buffer_id) {
+    struct client_destruction_listener *destruction_listener = (struct client_destruction_listener *) wl_client_get_destroy_listener(
+            client, on_client_destroyed);
+    if (destruction_listener->surface_tracker) {
+        westfield_surface_tracker_buffer_consumed(destruction_listener->surface_tracker, buffer_id);
     }
 }
 
@@ -116,6 +224,13 @@ on_wire_message(struct wl_client *client, int32_t *wire_message,
                 size_t wire_message_size, int object_id, int opcode) {
     struct client_destruction_listener *destruction_listener = (struct client_destruction_listener *) wl_client_get_destroy_listener(
             client, on_client_destroyed);
+    if (destruction_listener->surface_tracker &&
+        westfield_surface_tracker_request(destruction_listener->surface_tracker, (uint32_t *) wire_message,
+                                          wire_message_size, (uint32_t) object_id, (uint32_t) opcode)) {
+        // part of the commit record, JS does not need to see it on its own
+        free(wire_message);
+        return 0;
+    }
     if (destruction_listener->wire_message_cb_ref) {
         struct display_destruction_listener *display_destruction_listener;
         uint32_t cb_result_consumed;
@@ -199,6 +314,10 @@ on_registry_created(struct wl_client *client, struct wl_resource *registry, uint
             client,
             on_client_destroyed);
 
+    if (destruction_listener->surface_tracker) {
+        westfield_surface_tracker_registry_created(destruction_listener->surface_tracker, registry_id);
+    }
+
     if (destruction_listener->registry_created_cb_ref) {
         struct display_destruction_listener *display_destruction_listener = (struct display_destruction_listener *) wl_display_get_destroy_listener(
                 wl_client_get_display(client), on_display_destroyed);
@@ -258,6 +377,9 @@ on_client_created(struct wl_listener *listener, void *data) {
     destruction_listener->registry_created_cb_ref = NULL;
     destruction_listener->destroy_cb_ref = NULL;
     destruction_listener->buffer_created_cb_ref = NULL;
+    destruction_listener->surface_commit_cb_ref = NULL;
+    destruction_listener->surface_tracker = westfield_surface_tracker_create(client);
+    wl_list_init(&destruction_listener->pending_buffer_reads);
 
     wl_client_add_destroy_listener(client, &destruction_listener->listener);
     wl_client_set_wire_message_cb(client, on_wire_message);
@@ -519,6 +641,7 @@ sendEvents(napi_env env, napi_callback_info info) {
     napi_value argv[argc], client_value, messages_value, fds_value, return_value;
     struct wl_client *client;
     struct wl_connection *connection;
+    struct client_destruction_listener *destruction_listener;
     void *messages;
     int *fds;
     size_t messages_length, fds_length;
@@ -536,7 +659,14 @@ sendEvents(napi_env env, napi_callback_info info) {
     for (int i = 0; i < fds_length; ++i) {
         wl_connection_put_fd(connection, fds[i]);
     }
-    wl_connection_write(connection, messages, messages_length * 4);
+    destruction_listener = (struct client_destruction_listener *) wl_client_get_destroy_listener(client,
+                                                                                                 on_client_destroyed);
+    if (destruction_listener->surface_tracker) {
+        // frame callbacks of throttled surfaces are held back here, releases of natively released buffers dropped
+        westfield_surface_tracker_write_events(destruction_listener->surface_tracker, messages, messages_length * 4);
+    } else {
+        wl_connection_write(connection, messages, messages_length * 4);
+    }
 
     NAPI_CALL(env, napi_get_undefined(env, &return_value))
     return return_value;
@@ -613,34 +743,57 @@ getFd(napi_env env, napi_callback_info info) {
     return fd_value;
 }
 
+// shared by all displays, files are only reused once the client they were sent to has closed them
+static struct westfield_memfd_pool *memfd_pool = NULL;
+
 // expected arguments in order:
-// - number size
+// - Buffer contents
 // return:
-// - number
+// - number fd, -1 on error
 napi_value
 createMemoryMappedFile(napi_env env, napi_callback_info info) {
     void *contents;
     size_t argc = 1, size;
     napi_value argv[argc], buffer_value, fd_value;
     int fd;
-    ssize_t written;
 
     NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
     buffer_value = argv[0];
     NAPI_CALL(env, napi_get_buffer_info(env, buffer_value, &contents, &size))
 
-    fd = os_create_anonymous_file(size);
-    mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memfd_pool == NULL) {
+        memfd_pool = westfield_memfd_pool_create();
+    }
+    fd = memfd_pool ? westfield_memfd_pool_get(memfd_pool, contents, size) : -1;
+
+    NAPI_CALL(env, napi_create_int32(env, fd, &fd_value))
+    return fd_value;
+}
+
+// a keymap is about 60 KiB, so this is plenty for a few keymaps and what else is sent to all clients
+#define MEMFD_CACHE_MAX_FILES 32
+#define MEMFD_CACHE_MAX_BYTES (4 * 1024 * 1024)
+
+static struct westfield_memfd_cache *memfd_cache = NULL;
 
-    while (size > 0) {
-        // FIXME error handling
-        written = write(fd, contents, size);
-        if (written <= 0)
-            break;
+// expected arguments in order:
+// - Buffer contents
+// return:
+// - number fd of a sealed read only file, -1 on error
+napi_value
+createSealedMemoryMappedFile(napi_env env, napi_callback_info info) {
+    void *contents;
+    size_t argc = 1, size;
+    napi_value argv[argc], fd_value;
+    int fd;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    NAPI_CALL(env, napi_get_buffer_info(env, argv[0], &contents, &size))
 
-        contents += written;
-        size -= written;
+    if (memfd_cache == NULL) {
+        memfd_cache = westfield_memfd_cache_create(MEMFD_CACHE_MAX_FILES, MEMFD_CACHE_MAX_BYTES);
     }
+    fd = memfd_cache ? westfield_memfd_cache_get(memfd_cache, contents, size) : -1;
 
     NAPI_CALL(env, napi_create_int32(env, fd, &fd_value))
     return fd_value;
@@ -940,6 +1093,1027 @@ makePipe(napi_env env, napi_callback_info info) {
     return return_value;
 }
 
+static void
+on_surface_commit(void *data, const struct westfield_surface_commit *commit) {
+    struct wl_client *client = data;
+    struct client_destruction_listener *destruction_listener = (struct client_destruction_listener *) wl_client_get_destroy_listener(
+            client, on_client_destroyed);
+    struct display_destruction_listener *display_destruction_listener = (struct display_destruction_listener *) wl_display_get_destroy_listener(
+            wl_client_get_display(client), on_display_destroyed);
+    napi_env env = display_destruction_listener->env;
+    napi_value record_value, global, cb, cb_result;
+    const uint32_t rect_count = commit->surface_damage.count + commit->buffer_damage.count;
+    uint32_t *record;
+
+    // surface id, flags, buffer id, dx, dy, scale, transform, surface damage count, buffer damage count, rectangles
+    NAPI_CALL(env, napi_create_arraybuffer(env, (9 + rect_count * 4) * sizeof(uint32_t), (void **) &record,
+                                           &record_value))
+    record[0] = commit->surface_id;
+    record[1] = commit->buffer_attached ? 1 : 0;
+    record[2] = commit->buffer_id;
+    record[3] = (uint32_t) commit->dx;
+    record[4] = (uint32_t) commit->dy;
+    record[5] = (uint32_t) commit->scale;
+    record[6] = (uint32_t) commit->transform;
+    record[7] = commit->surface_damage.count;
+    record[8] = commit->buffer_damage.count;
+    memcpy(&record[9], commit->surface_damage.rects, commit->surface_damage.count * sizeof(struct westfield_damage_rect));
+    memcpy(&record[9 + commit->surface_damage.count * 4], commit->buffer_damage.rects,
+           commit->buffer_damage.count * sizeof(struct westfield_damage_rect));
+
+    NAPI_CALL(env, napi_get_reference_value(env, destruction_listener->surface_commit_cb_ref, &cb))
+    NAPI_CALL(env, napi_get_global(env, &global))
+    napi_value argv[1] = {record_value};
+    NAPI_CALL(env, napi_call_function(env, global, cb, 1, argv, &cb_result))
+}
+
+// expected arguments in order:
+// - Object client
+// - onSurfaceCommit(ArrayBuffer record):void or null to stop tracking
+// return:
+// - void
+napi_value
+setSurfaceCommitCallback(napi_env env, napi_callback_info info) {
+    size_t argc = 2;
+    napi_value argv[argc], client_value, surface_commit_cb_value, return_value;
+    napi_valuetype surface_commit_cb_type;
+    struct wl_client *client;
+    struct client_destruction_listener *destruction_listener;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    client_value = argv[0];
+    surface_commit_cb_value = argv[1];
+
+    NAPI_CALL(env, napi_get_value_external(env, client_value, (void **) &client))
+    NAPI_CALL(env, napi_typeof(env, surface_commit_cb_value, &surface_commit_cb_type))
+
+    destruction_listener = (struct client_destruction_listener *) wl_client_get_destroy_listener(client,
+                                                                                                 on_client_destroyed);
+    if (destruction_listener->surface_commit_cb_ref) {
+        NAPI_CALL(env, napi_delete_reference(env, destruction_listener->surface_commit_cb_ref))
+        destruction_listener->surface_commit_cb_ref = NULL;
+    }
+
+    if (surface_commit_cb_type == napi_function) {
+        NAPI_CALL(env, napi_create_reference(env, surface_commit_cb_value, 1,
+                                             &destruction_listener->surface_commit_cb_ref))
+        if (destruction_listener->surface_tracker) {
+            westfield_surface_tracker_set_commit_listener(destruction_listener->surface_tracker, on_surface_commit,
+                                                          client);
+        }
+    } else if (destruction_listener->surface_tracker) {
+        westfield_surface_tracker_set_commit_listener(destruction_listener->surface_tracker, NULL, NULL);
+    }
+
+    NAPI_CALL(env, napi_get_undefined(env, &return_value))
+    return return_value;
+}
+
+static void
+destroy_video_encoder(struct video_encoder_handle *handle) {
+    if (handle->encoder) {
+        westfield_video_encoder_destroy(handle->encoder);
+        handle->encoder = NULL;
+    }
+}
+
+static void
+finalize_video_encoder_handle(napi_env env, void *finalize_data, void *finalize_hint) {
+    struct video_encoder_handle *handle = finalize_data;
+    // an encode that is still running references the handle, so it is never busy here
+    destroy_video_encoder(handle);
+    free(handle);
+}
+
+// expected arguments in order:
+// - number bitrate in bits per second, 0 for best quality
+// - number frames per second
+// - number keyframe interval in frames, 0 for keyframes on demand only
+// return:
+// - Object video encoder
+napi_value
+createVideoEncoder(napi_env env, napi_callback_info info) {
+    size_t argc = 3;
+    napi_value argv[argc], return_value;
+    uint32_t bitrate, fps, keyframe_interval;
+    struct video_encoder_handle *handle;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    NAPI_CALL(env, napi_get_value_uint32(env, argv[0], &bitrate))
+    NAPI_CALL(env, napi_get_value_uint32(env, argv[1], &fps))
+    NAPI_CALL(env, napi_get_value_uint32(env, argv[2], &keyframe_interval))
+
+    handle = calloc(1, sizeof(struct video_encoder_handle));
+    if (handle == NULL) {
+        napi_throw_error(env, NULL, "Failed to allocate video encoder.");
+        return NULL;
+    }
+    handle->encoder = westfield_video_encoder_create(bitrate, fps, keyframe_interval);
+
+    NAPI_CALL(env, napi_create_external(env, handle, finalize_video_encoder_handle, NULL, &return_value))
+    return return_value;
+}
+
+static void
+video_encode_execute(napi_env env, void *data) {
+    struct video_encode_work *encode_work = data;
+    encode_work->chunk = westfield_video_encoder_encode(encode_work->handle->encoder, encode_work->pixels,
+                                                        encode_work->width, encode_work->height,
+                                                        encode_work->force_keyframe, &encode_work->chunk_size);
+}
+
+static void
+video_encode_complete(napi_env env, napi_status status, void *data) {
+    struct video_encode_work *encode_work = data;
+    struct video_encoder_handle *handle = encode_work->handle;
+    napi_value cb, global, cb_result, chunk_value, keyframe_value;
+
+    free(encode_work->pixels);
+    handle->busy = false;
+
+    if (handle->destroyed) {
+        free(encode_work->chunk);
+        destroy_video_encoder(handle);
+    } else {
+        if (handle->bitrate_pending) {
+            handle->encoder->bitrate = handle->pending_bitrate;
+            handle->bitrate_pending = false;
+        }
+        bool keyframe = false;
+        if (status == napi_ok && encode_work->chunk) {
+            keyframe = (encode_work->chunk[0] & WESTFIELD_VIDEO_CHUNK_KEYFRAME) != 0;
+            NAPI_CALL(env, napi_create_external_arraybuffer(env, encode_work->chunk, encode_work->chunk_size,
+                                                            finalize_cb, NULL, &chunk_value))
+        } else {
+            free(encode_work->chunk);
+            NAPI_CALL(env, napi_get_undefined(env, &chunk_value))
+        }
+        NAPI_CALL(env, napi_get_boolean(env, keyframe, &keyframe_value))
+        NAPI_CALL(env, napi_get_reference_value(env, encode_work->callback_ref, &cb))
+        NAPI_CALL(env, napi_get_global(env, &global))
+        napi_value argv[2] = {chunk_value, keyframe_value};
+        NAPI_CALL(env, napi_call_function(env, global, cb, 2, argv, &cb_result))
+    }
+
+    NAPI_CALL(env, napi_delete_reference(env, encode_work->callback_ref))
+    NAPI_CALL(env, napi_delete_reference(env, encode_work->handle_ref))
+    NAPI_CALL(env, napi_delete_async_work(env, encode_work->work))
+    free(encode_work);
+}
+
+// expected arguments in order:
+// - Object video encoder
+// - Object client
+// - number buffer id
+// - boolean force keyframe
+// - onChunk(ArrayBuffer|undefined chunk, boolean keyframe):void
+// return:
+// - boolean false if the encoder is still busy with a previous frame, the buffer is not a 32 bit shm buffer or its pool
+// is truncated
+napi_value
+encodeVideoFrame(napi_env env, napi_callback_info info) {
+    size_t argc = 5;
+    napi_value argv[argc], return_value, resource_name;
+    struct video_encoder_handle *handle;
+    struct wl_client *client;
+    struct wl_resource *resource;
+    struct wl_shm_buffer *shm_buffer;
+    struct video_encode_work *encode_work;
+    uint32_t id, format;
+    bool force_keyframe;
+    int32_t width, height, stride;
+    const uint8_t *data;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    NAPI_CALL(env, napi_get_value_external(env, argv[0], (void **) &handle))
+    NAPI_CALL(env, napi_get_value_external(env, argv[1], (void **) &client))
+    NAPI_CALL(env, napi_get_value_uint32(env, argv[2], &id))
+    NAPI_CALL(env, napi_get_value_bool(env, argv[3], &force_keyframe))
+
+    resource = wl_client_get_object(client, id);
+    shm_buffer = resource ? wl_shm_buffer_get(resource) : NULL;
+    format = shm_buffer ? wl_shm_buffer_get_format(shm_buffer) : 0;
+    if (handle->busy || handle->destroyed || handle->encoder == NULL || shm_buffer == NULL ||
+        (format != WL_SHM_FORMAT_ARGB8888 && format != WL_SHM_FORMAT_XRGB8888)) {
+        NAPI_CALL(env, napi_get_boolean(env, false, &return_value))
+        return return_value;
+    }
+
+    width = wl_shm_buffer_get_width(shm_buffer);
+    height = wl_shm_buffer_get_height(shm_buffer);
+    stride = wl_shm_buffer_get_stride(shm_buffer);
+
+    encode_work = calloc(1, sizeof(struct video_encode_work));
+    if (encode_work == NULL) {
+        NAPI_CALL(env, napi_get_boolean(env, false, &return_value))
+        return return_value;
+    }
+    encode_work->handle = handle;
+    encode_work->width = width;
+    encode_work->height = height;
+    encode_work->force_keyframe = force_keyframe;
+    // the client is free to reuse the buffer once we return, so take a packed copy for the worker thread
+    encode_work->pixels = malloc((size_t) width * height * sizeof(uint32_t));
+    if (encode_work->pixels == NULL) {
+        free(encode_work);
+        NAPI_CALL(env, napi_get_boolean(env, false, &return_value))
+        return return_value;
+    }
+    wl_shm_buffer_begin_access(shm_buffer);
+    data = wl_shm_buffer_get_data(shm_buffer);
+    for (int32_t row = 0; row < height; row++) {
+        memcpy(encode_work->pixels + (size_t) row * width, data + (size_t) row * stride, (size_t) width * 4);
+    }
+    if (wl_shm_buffer_end_access_checked(shm_buffer)) {
+        // the client truncated its pool, keep zeroed pages out of the chunk and the encoder's reference frame
+        free(encode_work->pixels);
+        free(encode_work);
+        NAPI_CALL(env, napi_get_boolean(env, false, &return_value))
+        return return_value;
+    }
+    release_consumed_buffer(client, id);
+
+    NAPI_CALL(env, napi_create_reference(env, argv[4], 1, &encode_work->callback_ref))
+    NAPI_CALL(env, napi_create_reference(env, argv[0], 1, &encode_work->handle_ref))
+    NAPI_CALL(env, napi_create_string_utf8(env, "westfield-video-encode", NAPI_AUTO_LENGTH, &resource_name))
+    NAPI_CALL(env, napi_create_async_work(env, NULL, resource_name, video_encode_execute, video_encode_complete,
+                                          encode_work, &encode_work->work))
+    NAPI_CALL(env, napi_queue_async_work(env, encode_work->work))
+    handle->busy = true;
+
+    NAPI_CALL(env, napi_get_boolean(env, true, &return_value))
+    return return_value;
+}
+
+// expected arguments in order:
+// - Object video encoder
+// - number bitrate in bits per second, 0 for best quality
+// return:
+// - void, nothing happens if the encoder is destroyed
+napi_value
+setVideoEncoderBitrate(napi_env env, napi_callback_info info) {
+    size_t argc = 2;
+    napi_value argv[argc], return_value;
+    struct video_encoder_handle *handle;
+    uint32_t bitrate;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    NAPI_CALL(env, napi_get_value_external(env, argv[0], (void **) &handle))
+    NAPI_CALL(env, napi_get_value_uint32(env, argv[1], &bitrate))
+
+    if (!handle->destroyed && handle->encoder) {
+        if (handle->busy) {
+            // the worker thread owns the encoder, applied once the frame completes
+            handle->pending_bitrate = bitrate;
+            handle->bitrate_pending = true;
+        } else {
+            handle->encoder->bitrate = bitrate;
+        }
+    }
+
+    NAPI_CALL(env, napi_get_undefined(env, &return_value))
+    return return_value;
+}
+
+// expected arguments in order:
+// - Object video encoder
+// return:
+// - void
+napi_value
+destroyVideoEncoder(napi_env env, napi_callback_info info) {
+    size_t argc = 1;
+    napi_value argv[argc], return_value;
+    struct video_encoder_handle *handle;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    NAPI_CALL(env, napi_get_value_external(env, argv[0], (void **) &handle))
+
+    if (!handle->busy) {
+        // else freed once the running encode completes
+        destroy_video_encoder(handle);
+    }
+    handle->destroyed = true;
+
+    NAPI_CALL(env, napi_get_undefined(env, &return_value))
+    return return_value;
+}
+
+// Only 32 bit formats are supported.
+static bool
+shm_snapshot_take(struct wl_client *client, uint32_t id, struct shm_snapshot *snapshot) {
+    struct wl_resource *resource = wl_client_get_object(client, id);
+    struct wl_shm_buffer *shm_buffer = resource ? wl_shm_buffer_get(resource) : NULL;
+
+    if (shm_buffer == NULL) {
+        return false;
+    }
+    snapshot->format = wl_shm_buffer_get_format(shm_buffer);
+    if (snapshot->format != WL_SHM_FORMAT_ARGB8888 && snapshot->format != WL_SHM_FORMAT_XRGB8888 &&
+        snapshot->format != WL_SHM_FORMAT_ABGR8888 && snapshot->format != WL_SHM_FORMAT_XBGR8888) {
+        return false;
+    }
+    snapshot->width = wl_shm_buffer_get_width(shm_buffer);
+    snapshot->height = wl_shm_buffer_get_height(shm_buffer);
+    snapshot->stride = wl_shm_buffer_get_stride(shm_buffer);
+    snapshot->pool = wl_shm_buffer_ref_pool(shm_buffer);
+    snapshot->data = wl_shm_buffer_get_data(shm_buffer);
+    return true;
+}
+
+// Must be called on the main thread.
+static void
+shm_snapshot_release(struct shm_snapshot *snapshot) {
+    wl_shm_pool_unref(snapshot->pool);
+    snapshot->pool = NULL;
+    snapshot->data = NULL;
+}
+
+static void
+thumbnail_execute(napi_env env, void *data) {
+    struct thumbnail_work *thumbnail_work = data;
+    struct shm_snapshot *snapshot = &thumbnail_work->snapshot;
+
+    wl_shm_pool_begin_access(snapshot->pool);
+    thumbnail_work->result = westfield_box_scale(snapshot->data, snapshot->width, snapshot->height, snapshot->stride,
+                                                 thumbnail_work->pixels, thumbnail_work->width,
+                                                 thumbnail_work->height, THUMBNAIL_MAX_THREADS);
+    // the client truncated its pool, we don't post an error from here as it might have disconnected already
+    if (wl_shm_pool_end_access(snapshot->pool)) {
+        thumbnail_work->result = -1;
+    }
+}
+
+static void
+thumbnail_complete(napi_env env, napi_status status, void *data) {
+    struct thumbnail_work *thumbnail_work = data;
+    napi_value cb, global, cb_result, pixels_value, format_value;
+
+    shm_snapshot_release(&thumbnail_work->snapshot);
+
+    if (status == napi_ok && thumbnail_work->result == 0) {
+        NAPI_CALL(env, napi_create_external_arraybuffer(env, thumbnail_work->pixels,
+                                                        (size_t) thumbnail_work->width * thumbnail_work->height * 4,
+                                                        finalize_cb, NULL, &pixels_value))
+    } else {
+        free(thumbnail_work->pixels);
+        NAPI_CALL(env, napi_get_undefined(env, &pixels_value))
+    }
+    NAPI_CALL(env, napi_create_uint32(env, thumbnail_work->snapshot.format, &format_value))
+    NAPI_CALL(env, napi_get_reference_value(env, thumbnail_work->callback_ref, &cb))
+    NAPI_CALL(env, napi_get_global(env, &global))
+    napi_value argv[2] = {pixels_value, format_value};
+    NAPI_CALL(env, napi_call_function(env, global, cb, 2, argv, &cb_result))
+
+    NAPI_CALL(env, napi_delete_reference(env, thumbnail_work->callback_ref))
+    NAPI_CALL(env, napi_delete_async_work(env, thumbnail_work->work))
+    free(thumbnail_work);
+}
+
+// expected arguments in order:
+// - Object client
+// - number buffer id
+// - number thumbnail width
+// - number thumbnail height
+// - onThumbnail(ArrayBuffer|undefined pixels, number shm format):void
+// return:
+// - boolean false if the buffer is not a 32 bit shm buffer or the thumbnail size is invalid
+napi_value
+thumbnail(napi_env env, napi_callback_info info) {
+    size_t argc = 5;
+    napi_value argv[argc], return_value, resource_name;
+    struct wl_client *client;
+    struct thumbnail_work *thumbnail_work;
+    uint32_t id, width, height;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    NAPI_CALL(env, napi_get_value_external(env, argv[0], (void **) &client))
+    NAPI_CALL(env, napi_get_value_uint32(env, argv[1], &id))
+    NAPI_CALL(env, napi_get_value_uint32(env, argv[2], &width))
+    NAPI_CALL(env, napi_get_value_uint32(env, argv[3], &height))
+
+    if (width == 0 || height == 0 || width > THUMBNAIL_MAX_SIZE || height > THUMBNAIL_MAX_SIZE) {
+        NAPI_CALL(env, napi_get_boolean(env, false, &return_value))
+        return return_value;
+    }
+
+    thumbnail_work = calloc(1, sizeof(struct thumbnail_work));
+    if (thumbnail_work == NULL) {
+        NAPI_CALL(env, napi_get_boolean(env, false, &return_value))
+        return return_value;
+    }
+    thumbnail_work->width = (int32_t) width;
+    thumbnail_work->height = (int32_t) height;
+    thumbnail_work->pixels = malloc((size_t) width * height * sizeof(uint32_t));
+    if (thumbnail_work->pixels == NULL || !shm_snapshot_take(client, id, &thumbnail_work->snapshot)) {
+        free(thumbnail_work->pixels);
+        free(thumbnail_work);
+        NAPI_CALL(env, napi_get_boolean(env, false, &return_value))
+        return return_value;
+    }
+
+    NAPI_CALL(env, napi_create_reference(env, argv[4], 1, &thumbnail_work->callback_ref))
+    NAPI_CALL(env, napi_create_string_utf8(env, "westfield-thumbnail", NAPI_AUTO_LENGTH, &resource_name))
+    NAPI_CALL(env, napi_create_async_work(env, NULL, resource_name, thumbnail_execute, thumbnail_complete,
+                                          thumbnail_work, &thumbnail_work->work))
+    NAPI_CALL(env, napi_queue_async_work(env, thumbnail_work->work))
+
+    NAPI_CALL(env, napi_get_boolean(env, true, &return_value))
+    return return_value;
+}
+
+static void
+i420_execute(napi_env env, void *data) {
+    struct i420_work *i420_work = data;
+    struct shm_snapshot *snapshot = &i420_work->snapshot;
+    const bool rgbx = snapshot->format == WL_SHM_FORMAT_ABGR8888 || snapshot->format == WL_SHM_FORMAT_XBGR8888;
+
+    wl_shm_pool_begin_access(snapshot->pool);
+    i420_work->result = westfield_convert_to_i420(snapshot->data, snapshot->width, snapshot->height, snapshot->stride,
+                                                  rgbx, i420_work->matrix, i420_work->planes, &i420_work->layout,
+                                                  I420_MAX_THREADS);
+    if (wl_shm_pool_end_access(snapshot->pool)) {
+        i420_work->result = -1;
+    }
+}
+
+static napi_value
+create_plane_layout(napi_env env, size_t offset, int32_t stride) {
+    napi_value plane, offset_value, stride_value;
+
+    NAPI_CALL(env, napi_create_uint32(env, (uint32_t) offset, &offset_value))
+    NAPI_CALL(env, napi_create_int32(env, stride, &stride_value))
+    const napi_property_descriptor properties[] = {
+            {"offset", NULL, NULL, NULL, NULL, offset_value, napi_enumerable, NULL},
+            {"stride", NULL, NULL, NULL, NULL, stride_value, napi_enumerable, NULL},
+    };
+    NAPI_CALL(env, napi_create_object(env, &plane))
+    NAPI_CALL(env, napi_define_properties(env, plane, sizeof(properties) / sizeof(napi_property_descriptor),
+                                          properties))
+    return plane;
+}
+
+static void
+i420_complete(napi_env env, napi_status status, void *data) {
+    struct i420_work *i420_work = data;
+    napi_value cb, global, cb_result, frame_value;
+
+    shm_snapshot_release(&i420_work->snapshot);
+    wl_list_remove(&i420_work->link);
+    if (i420_work->client && status == napi_ok && i420_work->result == 0) {
+        release_consumed_buffer(i420_work->client, i420_work->buffer_id);
+    }
+
+    if (status == napi_ok && i420_work->result == 0) {
+        napi_value buffer_value, width_value, height_value, layout_value;
+
+        if (i420_work->target_ref) {
+            NAPI_CALL(env, napi_get_reference_value(env, i420_work->target_ref, &buffer_value))
+        } else {
+            NAPI_CALL(env, napi_create_external_arraybuffer(env, i420_work->planes, i420_work->layout.size,
+                                                            finalize_cb, NULL, &buffer_value))
+        }
+        NAPI_CALL(env, napi_create_int32(env, i420_work->snapshot.width, &width_value))
+        NAPI_CALL(env, napi_create_int32(env, i420_work->snapshot.height, &height_value))
+        NAPI_CALL(env, napi_create_array_with_length(env, 3, &layout_value))
+        NAPI_CALL(env, napi_set_element(env, layout_value, 0,
+                                        create_plane_layout(env, i420_work->layout.y_offset,
+                                                            i420_work->layout.y_stride)))
+        NAPI_CALL(env, napi_set_element(env, layout_value, 1,
+                                        create_plane_layout(env, i420_work->layout.u_offset,
+                                                            i420_work->layout.uv_stride)))
+        NAPI_CALL(env, napi_set_element(env, layout_value, 2,
+                                        create_plane_layout(env, i420_work->layout.v_offset,
+                                                            i420_work->layout.uv_stride)))
+
+        const napi_property_descriptor properties[] = {
+                {"buffer", NULL, NULL, NULL, NULL, buffer_value, napi_enumerable, NULL},
+                {"width",  NULL, NULL, NULL, NULL, width_value,  napi_enumerable, NULL},
+                {"height", NULL, NULL, NULL, NULL, height_value, napi_enumerable, NULL},
+                {"layout", NULL, NULL, NULL, NULL, layout_value, napi_enumerable, NULL},
+        };
+        NAPI_CALL(env, napi_create_object(env, &frame_value))
+        NAPI_CALL(env, napi_define_properties(env, frame_value, sizeof(properties) / sizeof(napi_property_descriptor),
+                                              properties))
+    } else {
+        if (i420_work->target_ref == NULL) {
+            free(i420_work->planes);
+        }
+        NAPI_CALL(env, napi_get_undefined(env, &frame_value))
+    }
+    NAPI_CALL(env, napi_get_reference_value(env, i420_work->callback_ref, &cb))
+    NAPI_CALL(env, napi_get_global(env, &global))
+    napi_value argv[1] = {frame_value};
+    NAPI_CALL(env, napi_call_function(env, global, cb, 1, argv, &cb_result))
+
+    if (i420_work->target_ref) {
+        NAPI_CALL(env, napi_delete_reference(env, i420_work->target_ref))
+    }
+    NAPI_CALL(env, napi_delete_reference(env, i420_work->callback_ref))
+    NAPI_CALL(env, napi_delete_async_work(env, i420_work->work))
+    free(i420_work);
+}
+
+// expected arguments in order:
+// - Object client
+// - number buffer id
+// - number color matrix, 0 for BT.601, 1 for BT.709
+// - ArrayBuffer|undefined target, reused if it is large enough. Must not be touched until onFrame is called.
+// - onFrame({buffer: ArrayBuffer, width: number, height: number, layout: {offset: number, stride: number}[]}|undefined frame):void
+// return:
+// - boolean false if the buffer is not a 32 bit shm buffer
+napi_value
+convertToI420(napi_env env, napi_callback_info info) {
+    size_t argc = 5;
+    napi_value argv[argc], return_value, resource_name;
+    napi_valuetype target_type;
+    struct wl_client *client;
+    struct client_destruction_listener *destruction_listener;
+    struct i420_work *i420_work;
+    uint32_t id, matrix;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    NAPI_CALL(env, napi_get_value_external(env, argv[0], (void **) &client))
+    NAPI_CALL(env, napi_get_value_uint32(env, argv[1], &id))
+    NAPI_CALL(env, napi_get_value_uint32(env, argv[2], &matrix))
+    NAPI_CALL(env, napi_typeof(env, argv[3], &target_type))
+
+    i420_work = calloc(1, sizeof(struct i420_work));
+    if (i420_work == NULL) {
+        NAPI_CALL(env, napi_get_boolean(env, false, &return_value))
+        return return_value;
+    }
+    if (!shm_snapshot_take(client, id, &i420_work->snapshot)) {
+        free(i420_work);
+        NAPI_CALL(env, napi_get_boolean(env, false, &return_value))
+        return return_value;
+    }
+    i420_work->matrix = matrix == WESTFIELD_YUV_MATRIX_BT709 ? WESTFIELD_YUV_MATRIX_BT709 : WESTFIELD_YUV_MATRIX_BT601;
+    westfield_i420_layout(i420_work->snapshot.width, i420_work->snapshot.height, &i420_work->layout);
+
+    if (target_type != napi_undefined && target_type != napi_null) {
+        size_t target_length;
+        void *target;
+
+        NAPI_CALL(env, napi_get_arraybuffer_info(env, argv[3], &target, &target_length))
+        if (target_length >= i420_work->layout.size) {
+            i420_work->planes = target;
+            NAPI_CALL(env, napi_create_reference(env, argv[3], 1, &i420_work->target_ref))
+        }
+    }
+    if (i420_work->planes == NULL) {
+        i420_work->planes = malloc(i420_work->layout.size);
+    }
+    if (i420_work->planes == NULL) {
+        shm_snapshot_release(&i420_work->snapshot);
+        free(i420_work);
+        NAPI_CALL(env, napi_get_boolean(env, false, &return_value))
+        return return_value;
+    }
+
+    i420_work->client = client;
+    i420_work->buffer_id = id;
+    destruction_listener = (struct client_destruction_listener *) wl_client_get_destroy_listener(client,
+                                                                                                 on_client_destroyed);
+    wl_list_insert(&destruction_listener->pending_buffer_reads, &i420_work->link);
+
+    NAPI_CALL(env, napi_create_reference(env, argv[4], 1, &i420_work->callback_ref))
+    NAPI_CALL(env, napi_create_string_utf8(env, "westfield-i420", NAPI_AUTO_LENGTH, &resource_name))
+    NAPI_CALL(env, napi_create_async_work(env, NULL, resource_name, i420_execute, i420_complete, i420_work,
+                                          &i420_work->work))
+    NAPI_CALL(env, napi_queue_async_work(env, i420_work->work))
+
+    NAPI_CALL(env, napi_get_boolean(env, true, &return_value))
+    return return_value;
+}
+
+static void
+destroy_scroll_detector(struct scroll_detector_handle *handle) {
+    if (handle->detector) {
+        westfield_scroll_detector_destroy(handle->detector);
+        handle->detector = NULL;
+    }
+}
+
+static void
+finalize_scroll_detector_handle(napi_env env, void *finalize_data, void *finalize_hint) {
+    struct scroll_detector_handle *handle = finalize_data;
+    destroy_scroll_detector(handle);
+    free(handle);
+}
+
+// return:
+// - Object scroll detector
+napi_value
+createScrollDetector(napi_env env, napi_callback_info info) {
+    napi_value return_value;
+    struct scroll_detector_handle *handle;
+
+    handle = calloc(1, sizeof(struct scroll_detector_handle));
+    if (handle == NULL) {
+        napi_throw_error(env, NULL, "Failed to allocate scroll detector.");
+        return NULL;
+    }
+    handle->detector = westfield_scroll_detector_create();
+    if (handle->detector == NULL) {
+        free(handle);
+        napi_throw_error(env, NULL, "Failed to allocate scroll detector.");
+        return NULL;
+    }
+
+    NAPI_CALL(env, napi_create_external(env, handle, finalize_scroll_detector_handle, NULL, &return_value))
+    return return_value;
+}
+
+// expected arguments in order:
+// - Object scroll detector
+// - Object client
+// - number buffer id
+// return:
+// - ArrayBuffer|null int32 record of [scrolled, dx, dy, copy x, copy y, copy width, copy height, exposed count,
+// exposed rects...], null if the buffer is not a 32 bit shm buffer, its pool is truncated or the detector is destroyed
+napi_value
+detectScroll(napi_env env, napi_callback_info info) {
+    size_t argc = 3;
+    napi_value argv[argc], return_value;
+    struct scroll_detector_handle *handle;
+    struct westfield_scroll_result result;
+    struct wl_client *client;
+    struct wl_resource *resource;
+    struct wl_shm_buffer *shm_buffer;
+    uint32_t id, format;
+    int32_t *record;
+    int detected;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    NAPI_CALL(env, napi_get_value_external(env, argv[0], (void **) &handle))
+    NAPI_CALL(env, napi_get_value_external(env, argv[1], (void **) &client))
+    NAPI_CALL(env, napi_get_value_uint32(env, argv[2], &id))
+
+    resource = wl_client_get_object(client, id);
+    shm_buffer = resource ? wl_shm_buffer_get(resource) : NULL;
+    format = shm_buffer ? wl_shm_buffer_get_format(shm_buffer) : 0;
+    if (handle->detector == NULL || shm_buffer == NULL ||
+        (format != WL_SHM_FORMAT_ARGB8888 && format != WL_SHM_FORMAT_XRGB8888 &&
+         format != WL_SHM_FORMAT_ABGR8888 && format != WL_SHM_FORMAT_XBGR8888)) {
+        NAPI_CALL(env, napi_get_null(env, &return_value))
+        return return_value;
+    }
+
+    wl_shm_buffer_begin_access(shm_buffer);
+    detected = westfield_scroll_detector_detect(handle->detector, wl_shm_buffer_get_data(shm_buffer),
+                                                wl_shm_buffer_get_width(shm_buffer),
+                                                wl_shm_buffer_get_height(shm_buffer),
+                                                wl_shm_buffer_get_stride(shm_buffer), &result);
+    if (wl_shm_buffer_end_access_checked(shm_buffer)) {
+        // the client truncated its pool, don't compare the next frame with zeroed pages
+        if (detected == 0) {
+            westfield_scroll_detector_revert(handle->detector);
+        }
+        detected = -1;
+    }
+    if (detected) {
+        NAPI_CALL(env, napi_get_null(env, &return_value))
+        return return_value;
+    }
+
+    NAPI_CALL(env, napi_create_arraybuffer(env, (8 + result.exposed_count * 4) * sizeof(int32_t), (void **) &record,
+                                           &return_value))
+    record[0] = result.scrolled ? 1 : 0;
+    record[1] = result.dx;
+    record[2] = result.dy;
+    record[3] = result.copy.x;
+    record[4] = result.copy.y;
+    record[5] = result.copy.width;
+    record[6] = result.copy.height;
+    record[7] = result.exposed_count;
+    memcpy(record + 8, result.exposed, result.exposed_count * sizeof(struct westfield_rect));
+    return return_value;
+}
+
+// expected arguments in order:
+// - Object scroll detector
+// return:
+// - void, nothing happens if the detector is already destroyed
+napi_value
+destroyScrollDetector(napi_env env, napi_callback_info info) {
+    size_t argc = 1;
+    napi_value argv[argc], return_value;
+    struct scroll_detector_handle *handle;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    NAPI_CALL(env, napi_get_value_external(env, argv[0], (void **) &handle))
+
+    // the handle itself lives until the JS object is collected
+    destroy_scroll_detector(handle);
+
+    NAPI_CALL(env, napi_get_undefined(env, &return_value))
+    return return_value;
+}
+
+napi_value
+setFrameRateCap(napi_env env, napi_callback_info info) {
+    size_t argc = 3;
+    napi_value argv[argc], client_value, surface_id_value, fps_value, return_value;
+    struct wl_client *client;
+    struct client_destruction_listener *destruction_listener;
+    uint32_t surface_id, fps;
+    int result = -1;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    // expected arguments in order:
+    // Object client
+    // number surface id, 0 for all surfaces of the client
+    // number frames per second, 0 for uncapped
+    client_value = argv[0];
+    surface_id_value = argv[1];
+    fps_value = argv[2];
+
+    NAPI_CALL(env, napi_get_value_external(env, client_value, (void **) &client))
+    NAPI_CALL(env, napi_get_value_uint32(env, surface_id_value, &surface_id))
+    NAPI_CALL(env, napi_get_value_uint32(env, fps_value, &fps))
+
+    destruction_listener = (struct client_destruction_listener *) wl_client_get_destroy_listener(client,
+                                                                                                 on_client_destroyed);
+    if (destruction_listener->surface_tracker) {
+        result = westfield_surface_tracker_set_frame_rate_cap(destruction_listener->surface_tracker, surface_id, fps);
+    }
+
+    NAPI_CALL(env, napi_get_boolean(env, result == 0, &return_value))
+    return return_value;
+}
+
+// expected arguments in order:
+// - Object client
+// - number buffer id
+// return:
+// - boolean false if the buffer is not a committed shm buffer that is still held
+napi_value
+releaseBuffer(napi_env env, napi_callback_info info) {
+    size_t argc = 2;
+    napi_value argv[argc], return_value;
+    struct wl_client *client;
+    struct client_destruction_listener *destruction_listener;
+    uint32_t id;
+    int result = -1;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    NAPI_CALL(env, napi_get_value_external(env, argv[0], (void **) &client))
+    NAPI_CALL(env, napi_get_value_uint32(env, argv[1], &id))
+
+    destruction_listener = (struct client_destruction_listener *) wl_client_get_destroy_listener(client,
+                                                                                                 on_client_destroyed);
+    if (destruction_listener->surface_tracker) {
+        result = westfield_surface_tracker_release_buffer(destruction_listener->surface_tracker, id);
+    }
+
+    NAPI_CALL(env, napi_get_boolean(env, result == 0, &return_value))
+    return return_value;
+}
+
+// expected arguments in order:
+// - Object client
+// - boolean release shm buffers as soon as encodeVideoFrame or convertToI420 has read them
+// return:
+// - void
+napi_value
+setBufferAutoRelease(napi_env env, napi_callback_info info) {
+    size_t argc = 2;
+    napi_value argv[argc], return_value;
+    struct wl_client *client;
+    struct client_destruction_listener *destruction_listener;
+    bool auto_release;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    NAPI_CALL(env, napi_get_value_external(env, argv[0], (void **) &client))
+    NAPI_CALL(env, napi_get_value_bool(env, argv[1], &auto_release))
+
+    destruction_listener = (struct client_destruction_listener *) wl_client_get_destroy_listener(client,
+                                                                                                 on_client_destroyed);
+    if (destruction_listener->surface_tracker) {
+        westfield_surface_tracker_set_auto_release(destruction_listener->surface_tracker, auto_release);
+    }
+
+    NAPI_CALL(env, napi_get_undefined(env, &return_value))
+    return return_value;
+}
+
+// expected arguments in order:
+// - Object client
+// return:
+// - Object buffer statistics
+napi_value
+getBufferStats(napi_env env, napi_callback_info info) {
+    size_t argc = 1;
+    napi_value argv[argc], result, held_value, max_held_value, commits_value, releases_value, native_releases_value,
+            total_hold_ms_value, max_hold_ms_value;
+    struct wl_client *client;
+    struct client_destruction_listener *destruction_listener;
+    struct westfield_buffer_stats stats = {0};
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    NAPI_CALL(env, napi_get_value_external(env, argv[0], (void **) &client))
+
+    destruction_listener = (struct client_destruction_listener *) wl_client_get_destroy_listener(client,
+                                                                                                 on_client_destroyed);
+    if (destruction_listener->surface_tracker) {
+        westfield_surface_tracker_get_buffer_stats(destruction_listener->surface_tracker, &stats);
+    }
+
+    NAPI_CALL(env, napi_create_uint32(env, stats.held, &held_value))
+    NAPI_CALL(env, napi_create_uint32(env, stats.max_held, &max_held_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.commits, &commits_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.releases, &releases_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.native_releases, &native_releases_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.total_hold_ms, &total_hold_ms_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.max_hold_ms, &max_hold_ms_value))
+
+    const napi_property_descriptor properties[] = {
+            {"held",           NULL, NULL, NULL, NULL, held_value,            napi_enumerable, NULL},
+            {"maxHeld",        NULL, NULL, NULL, NULL, max_held_value,        napi_enumerable, NULL},
+            {"commits",        NULL, NULL, NULL, NULL, commits_value,         napi_enumerable, NULL},
+            {"releases",       NULL, NULL, NULL, NULL, releases_value,        napi_enumerable, NULL},
+            {"nativeReleases", NULL, NULL, NULL, NULL, native_releases_value, napi_enumerable, NULL},
+            {"totalHoldMs",    NULL, NULL, NULL, NULL, total_hold_ms_value,   napi_enumerable, NULL},
+            {"maxHoldMs",      NULL, NULL, NULL, NULL, max_hold_ms_value,     napi_enumerable, NULL},
+    };
+
+    NAPI_CALL(env, napi_create_object(env, &result))
+    NAPI_CALL(env, napi_define_properties(env, result, sizeof(properties) / sizeof(napi_property_descriptor),
+                                          properties))
+    return result;
+}
+
+napi_value
+compressBatch(napi_env env, napi_callback_info info) {
+    size_t argc = 2;
+    napi_value argv[argc], source_value, target_value, return_value;
+    napi_typedarray_type source_type, target_type;
+    size_t source_length, target_length, compressed_length;
+    uint8_t *source, *target;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    // expected arguments in order:
+    // Uint8Array source - the flushed batch
+    // Uint8Array target - receives the compressed batch
+    source_value = argv[0];
+    target_value = argv[1];
+
+    NAPI_CALL(env, napi_get_typedarray_info(env, source_value, &source_type, &source_length, (void **) &source, NULL,
+                                            NULL))
+    NAPI_CALL(env, napi_get_typedarray_info(env, target_value, &target_type, &target_length, (void **) &target, NULL,
+                                            NULL))
+    if (source_type != napi_uint8_array || target_type != napi_uint8_array) {
+        napi_throw_type_error(env, NULL, "Expected Uint8Array arguments.");
+        return NULL;
+    }
+
+    compressed_length = westfield_compress_block(source, source_length, target, target_length);
+
+    NAPI_CALL(env, napi_create_uint32(env, (uint32_t) compressed_length, &return_value))
+    return return_value;
+}
+
+napi_value
+hashShmBuffer(napi_env env, napi_callback_info info) {
+    size_t argc = 2;
+    napi_value argv[argc], client_value, id_value, result;
+    uint32_t id;
+    struct wl_client *client;
+    struct wl_resource *resource;
+    struct wl_shm_buffer *shm_buffer;
+
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL))
+    // expected arguments in order:
+    // Object client
+    // number buffer id
+    client_value = argv[0];
+    id_value = argv[1];
+
+    NAPI_CALL(env, napi_get_value_external(env, client_value, (void **) &client))
+    NAPI_CALL(env, napi_get_value_uint32(env, id_value, &id))
+
+    resource = wl_client_get_object(client, id);
+    shm_buffer = resource ? wl_shm_buffer_get(resource) : NULL;
+    if (shm_buffer) {
+        const int32_t width = wl_shm_buffer_get_width(shm_buffer);
+        const int32_t height = wl_shm_buffer_get_height(shm_buffer);
+        const int32_t stride = wl_shm_buffer_get_stride(shm_buffer);
+        const uint32_t format = wl_shm_buffer_get_format(shm_buffer);
+        // only the 32 bit formats are known to have padding we can skip, hash complete rows for anything else
+        const size_t row_size = format == WL_SHM_FORMAT_ARGB8888 || format == WL_SHM_FORMAT_XRGB8888 ?
+                                (size_t) width * 4 : (size_t) stride;
+        uint64_t hash;
+        int access_result;
+
+        wl_shm_buffer_begin_access(shm_buffer);
+        hash = westfield_hash_pixels(wl_shm_buffer_get_data(shm_buffer), width, height, stride, format, row_size);
+        access_result = wl_shm_buffer_end_access_checked(shm_buffer);
+
+        // the client truncated its pool, the hash covers zeroed pages instead of its contents
+        if (access_result == 0) {
+            NAPI_CALL(env, napi_create_bigint_uint64(env, hash, &result))
+            return result;
+        }
+    }
+
+    NAPI_CALL(env, napi_get_null(env, &result))
+    return result;
+}
+
+// return:
+// - Object counters of the shm pools of all displays
+napi_value
+getShmStats(napi_env env, napi_callback_info info) {
+    napi_value result, pools_created_value, bytes_prefaulted_value, resizes_in_place_value, resizes_moved_value,
+            accesses_value, access_page_faults_value, sigbus_faults_value;
+    struct wl_shm_stats stats;
+
+    wl_shm_get_stats(&stats);
+
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.pools_created, &pools_created_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.bytes_prefaulted, &bytes_prefaulted_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.resizes_in_place, &resizes_in_place_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.resizes_moved, &resizes_moved_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.accesses, &accesses_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.access_page_faults, &access_page_faults_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.sigbus_faults, &sigbus_faults_value))
+
+    const napi_property_descriptor properties[] = {
+            {"poolsCreated",     NULL, NULL, NULL, NULL, pools_created_value,      napi_enumerable, NULL},
+            {"bytesPrefaulted",  NULL, NULL, NULL, NULL, bytes_prefaulted_value,   napi_enumerable, NULL},
+            {"resizesInPlace",   NULL, NULL, NULL, NULL, resizes_in_place_value,   napi_enumerable, NULL},
+            {"resizesMoved",     NULL, NULL, NULL, NULL, resizes_moved_value,      napi_enumerable, NULL},
+            {"accesses",         NULL, NULL, NULL, NULL, accesses_value,           napi_enumerable, NULL},
+            {"accessPageFaults", NULL, NULL, NULL, NULL, access_page_faults_value, napi_enumerable, NULL},
+            {"sigbusFaults",     NULL, NULL, NULL, NULL, sigbus_faults_value,      napi_enumerable, NULL},
+    };
+
+    NAPI_CALL(env, napi_create_object(env, &result))
+    NAPI_CALL(env, napi_define_properties(env, result, sizeof(properties) / sizeof(napi_property_descriptor),
+                                          properties))
+    return result;
+}
+
+// return:
+// - Object statistics of the files created by createMemoryMappedFile
+napi_value
+getMemoryMappedFileStats(napi_env env, napi_callback_info info) {
+    napi_value result, hits_value, misses_value, files_value, resident_bytes_value;
+    struct westfield_memfd_pool_stats stats = {0};
+
+    if (memfd_pool) {
+        westfield_memfd_pool_get_stats(memfd_pool, &stats);
+    }
+
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.hits, &hits_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.misses, &misses_value))
+    NAPI_CALL(env, napi_create_uint32(env, stats.files, &files_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.resident_bytes, &resident_bytes_value))
+
+    const napi_property_descriptor properties[] = {
+            {"hits",          NULL, NULL, NULL, NULL, hits_value,           napi_enumerable, NULL},
+            {"misses",        NULL, NULL, NULL, NULL, misses_value,         napi_enumerable, NULL},
+            {"files",         NULL, NULL, NULL, NULL, files_value,          napi_enumerable, NULL},
+            {"residentBytes", NULL, NULL, NULL, NULL, resident_bytes_value, napi_enumerable, NULL},
+    };
+
+    NAPI_CALL(env, napi_create_object(env, &result))
+    NAPI_CALL(env, napi_define_properties(env, result, sizeof(properties) / sizeof(napi_property_descriptor),
+                                          properties))
+    return result;
+}
+
+// return:
+// - Object statistics of the files created by createSealedMemoryMappedFile
+napi_value
+getSealedMemoryMappedFileStats(napi_env env, napi_callback_info info) {
+    napi_value result, hits_value, misses_value, evictions_value, files_value, bytes_value;
+    struct westfield_memfd_cache_stats stats = {0};
+
+    if (memfd_cache) {
+        westfield_memfd_cache_get_stats(memfd_cache, &stats);
+    }
+
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.hits, &hits_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.misses, &misses_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.evictions, &evictions_value))
+    NAPI_CALL(env, napi_create_uint32(env, stats.files, &files_value))
+    NAPI_CALL(env, napi_create_int64(env, (int64_t) stats.bytes, &bytes_value))
+
+    const napi_property_descriptor properties[] = {
+            {"hits",      NULL, NULL, NULL, NULL, hits_value,      napi_enumerable, NULL},
+            {"misses",    NULL, NULL, NULL, NULL, misses_value,    napi_enumerable, NULL},
+            {"evictions", NULL, NULL, NULL, NULL, evictions_value, napi_enumerable, NULL},
+            {"files",     NULL, NULL, NULL, NULL, files_value,     napi_enumerable, NULL},
+            {"bytes",     NULL, NULL, NULL, NULL, bytes_value,     napi_enumerable, NULL},
+    };
+
+    NAPI_CALL(env, napi_create_object(env, &result))
+    NAPI_CALL(env, napi_define_properties(env, result, sizeof(properties) / sizeof(napi_property_descriptor),
+                                          properties))
+    return result;
+}
+
 // TODO temp method - to be replaced by general encoding function
 napi_value
 getShmBuffer(napi_env env, napi_callback_info info) {
@@ -1027,10 +2201,19 @@ westfield_xserver_destroyed(void *user_data) {
     free(weston_xwayland_callbacks);
 }
 
+// expected arguments in order:
+// - Object display
+// - onXWaylandStarting(number wm fd, Object client):void
+// - onXWaylandDestroyed():void
+// - boolean|undefined prewarm, keep an Xwayland ready before the first X client connects
+// return:
+// - Object|undefined
 napi_value
 setupXWayland(napi_env env, napi_callback_info info) {
-    size_t argc = 3;
+    size_t argc = 4;
     napi_value argv[argc], display_value, starting_js_cb, destroyed_js_cb, return_value;
+    napi_valuetype prewarm_type;
+    bool prewarm = false;
     struct wl_display *display;
     struct westfield_xwayland *westfield_xwayland;
     struct weston_xwayland_callbacks *weston_xwayland_callbacks;
@@ -1041,6 +2224,10 @@ setupXWayland(napi_env env, napi_callback_info info) {
     display_value = argv[0];
     starting_js_cb = argv[1];
     destroyed_js_cb = argv[2];
+    NAPI_CALL(env, napi_typeof(env, argv[3], &prewarm_type))
+    if (prewarm_type == napi_boolean) {
+        NAPI_CALL(env, napi_get_value_bool(env, argv[3], &prewarm))
+    }
 
     NAPI_CALL(env, napi_create_reference(env, starting_js_cb, 1, &starting_cb_ref))
     NAPI_CALL(env, napi_create_reference(env, destroyed_js_cb, 1, &destroyed_cb_ref))
@@ -1054,7 +2241,8 @@ setupXWayland(napi_env env, napi_callback_info info) {
     westfield_xwayland = setup_xwayland((struct wl_dislay *) display,
                                         weston_xwayland_callbacks,
                                         westfield_xserver_starting,
-                                        westfield_xserver_destroyed);
+                                        westfield_xserver_destroyed,
+                                        prewarm);
 
     if (westfield_xwayland) {
         NAPI_CALL(env, napi_create_external(env, westfield_xwayland, NULL, NULL, &return_value))
@@ -1128,6 +2316,7 @@ init(napi_env env, napi_value exports) {
             DECLARE_NAPI_METHOD("dispatchRequests", dispatchRequests),
             DECLARE_NAPI_METHOD("flush", flush),
             DECLARE_NAPI_METHOD("createMemoryMappedFile", createMemoryMappedFile),
+            DECLARE_NAPI_METHOD("createSealedMemoryMappedFile", createSealedMemoryMappedFile),
             DECLARE_NAPI_METHOD("initShm", initShm),
             DECLARE_NAPI_METHOD("setWireMessageCallback", setWireMessageCallback),
             DECLARE_NAPI_METHOD("setWireMessageEndCallback", setWireMessageEndCallback),
@@ -1142,10 +2331,31 @@ init(napi_env env, napi_value exports) {
             DECLARE_NAPI_METHOD("setBufferCreatedCallback", setBufferCreatedCallback),
             DECLARE_NAPI_METHOD("getServerObjectIdsBatch", getServerObjectIdsBatch),
             DECLARE_NAPI_METHOD("makePipe", makePipe),
+            DECLARE_NAPI_METHOD("setFrameRateCap", setFrameRateCap),
+            DECLARE_NAPI_METHOD("setSurfaceCommitCallback", setSurfaceCommitCallback),
+            DECLARE_NAPI_METHOD("releaseBuffer", releaseBuffer),
+            DECLARE_NAPI_METHOD("setBufferAutoRelease", setBufferAutoRelease),
+            DECLARE_NAPI_METHOD("getBufferStats", getBufferStats),
+            DECLARE_NAPI_METHOD("compressBatch", compressBatch),
+            DECLARE_NAPI_METHOD("getShmStats", getShmStats),
+            DECLARE_NAPI_METHOD("getMemoryMappedFileStats", getMemoryMappedFileStats),
+            DECLARE_NAPI_METHOD("getSealedMemoryMappedFileStats", getSealedMemoryMappedFileStats),
             // TODO temp method - to be replaced by general encoding function
             DECLARE_NAPI_METHOD("getShmBuffer", getShmBuffer),
             DECLARE_NAPI_METHOD("equalValueExternal", equalValueExternal),
 
+            // video
+            DECLARE_NAPI_METHOD("createVideoEncoder", createVideoEncoder),
+            DECLARE_NAPI_METHOD("encodeVideoFrame", encodeVideoFrame),
+            DECLARE_NAPI_METHOD("setVideoEncoderBitrate", setVideoEncoderBitrate),
+            DECLARE_NAPI_METHOD("destroyVideoEncoder", destroyVideoEncoder),
+            DECLARE_NAPI_METHOD("hashShmBuffer", hashShmBuffer),
+            DECLARE_NAPI_METHOD("thumbnail", thumbnail),
+            DECLARE_NAPI_METHOD("convertToI420", convertToI420),
+            DECLARE_NAPI_METHOD("createScrollDetector", createScrollDetector),
+            DECLARE_NAPI_METHOD("detectScroll", detectScroll),
+            DECLARE_NAPI_METHOD("destroyScrollDetector", destroyScrollDetector),
+
             // xwayland
             DECLARE_NAPI_METHOD("setupXWayland", setupXWayland),
             DECLARE_NAPI_METHOD("teardownXWayland", teardownXWayland),
@@ -1154,8 +2364,6 @@ init(napi_env env, napi_value exports) {
 
     NAPI_CALL(env, napi_define_properties(env, exports, sizeof(desc) / sizeof(napi_property_descriptor), desc))
 
-    init_westfield_xwayland();
-
     return exports;
 }
 
@@ -0,0 +1,183 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include "westfield-parallel.h"
+
+// don't bother starting a thread for less pixels than this
+#define MIN_PIXELS_PER_THREAD (256 * 1024)
+#define MAX_THREADS 8
+
+struct rows_call {
+    westfield_rows_func_t rows_func;
+    void *data;
+    // bands handed to the pool that did not finish yet
+    int unfinished;
+};
+
+struct rows_band {
+    struct rows_call *call;
+    struct rows_band *next;
+    int32_t first_row;
+    int32_t last_row;
+    int result;
+};
+
+/*
+ * Workers are started on first use and live as long as the process. Calls can come from any thread, eg. from several
+ * libuv workers at once, so they all share a single queue of bands.
+ */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_finished = PTHREAD_COND_INITIALIZER;
+static struct rows_band *queue_head;
+static struct rows_band *queue_tail;
+static int worker_count;
+
+static void
+rows_band_run(struct rows_band *band) {
+    band->result = band->call->rows_func(band->call->data, band->first_row, band->last_row);
+}
+
+// with pool_mutex held
+static void
+queue_push(struct rows_band *band) {
+    band->next = NULL;
+    if (queue_tail) {
+        queue_tail->next = band;
+    } else {
+        queue_head = band;
+    }
+    queue_tail = band;
+}
+
+// with pool_mutex held, takes the first queued band of the given call or of any call if NULL
+static struct rows_band *
+queue_take(struct rows_call *call) {
+    struct rows_band *previous = NULL;
+
+    for (struct rows_band *band = queue_head; band; previous = band, band = band->next) {
+        if (call && band->call != call) {
+            continue;
+        }
+        if (previous) {
+            previous->next = band->next;
+        } else {
+            queue_head = band->next;
+        }
+        if (queue_tail == band) {
+            queue_tail = previous;
+        }
+        return band;
+    }
+    return NULL;
+}
+
+// with pool_mutex held
+static void
+band_finished(struct rows_band *band) {
+    if (--band->call->unfinished == 0) {
+        pthread_cond_broadcast(&pool_finished);
+    }
+}
+
+static void *
+worker_run(void *data) {
+    pthread_mutex_lock(&pool_mutex);
+    while (true) {
+        struct rows_band *band = queue_take(NULL);
+        if (band == NULL) {
+            pthread_cond_wait(&pool_queued, &pool_mutex);
+            continue;
+        }
+
+        pthread_mutex_unlock(&pool_mutex);
+        rows_band_run(band);
+        pthread_mutex_lock(&pool_mutex);
+        band_finished(band);
+    }
+    return NULL;
+}
+
+// with pool_mutex held
+static void
+ensure_workers(int count) {
+    pthread_attr_t attr;
+
+    if (worker_count >= count || pthread_attr_init(&attr)) {
+        return;
+    }
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (worker_count < count) {
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, worker_run, NULL)) {
+            // bands that no worker picks up are processed by the calling thread
+            break;
+        }
+        worker_count++;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+int
+westfield_parallel_rows(int32_t rows, int64_t pixels, int max_threads, westfield_rows_func_t rows_func, void *data) {
+    struct rows_call call = {
+            .rows_func = rows_func,
+            .data = data,
+    };
+    struct rows_band bands[MAX_THREADS];
+    struct rows_band *band;
+    int64_t band_count = pixels / MIN_PIXELS_PER_THREAD;
+    int result = 0;
+
+    if (band_count > max_threads) {
+        band_count = max_threads;
+    }
+    if (band_count > MAX_THREADS) {
+        band_count = MAX_THREADS;
+    }
+    if (band_count > rows) {
+        band_count = rows;
+    }
+    if (band_count < 1) {
+        band_count = 1;
+    }
+
+    for (int i = 0; i < band_count; i++) {
+        bands[i].call = &call;
+        bands[i].first_row = (int32_t) ((int64_t) rows * i / band_count);
+        bands[i].last_row = (int32_t) ((int64_t) rows * (i + 1) / band_count);
+        bands[i].result = 0;
+    }
+
+    // the last band is done on the calling thread
+    if (band_count > 1) {
+        pthread_mutex_lock(&pool_mutex);
+        ensure_workers((int) band_count - 1);
+        for (int i = 0; i < band_count - 1; i++) {
+            queue_push(&bands[i]);
+        }
+        call.unfinished = (int) band_count - 1;
+        pthread_cond_broadcast(&pool_queued);
+        pthread_mutex_unlock(&pool_mutex);
+    }
+    rows_band_run(&bands[band_count - 1]);
+
+    if (band_count > 1) {
+        pthread_mutex_lock(&pool_mutex);
+        // all workers may be busy with other calls, don't wait for them to get to ours
+        while ((band = queue_take(&call))) {
+            pthread_mutex_unlock(&pool_mutex);
+            rows_band_run(band);
+            pthread_mutex_lock(&pool_mutex);
+            band_finished(band);
+        }
+        while (call.unfinished) {
+            pthread_cond_wait(&pool_finished, &pool_mutex);
+        }
+        pthread_mutex_unlock(&pool_mutex);
+    }
+
+    for (int i = 0; i < band_count; i++) {
+        result |= bands[i].result;
+    }
+    return result;
+}
@@ -0,0 +1,26 @@
+//
+// Splitting row based image work over a few threads.
+//
+
+#ifndef WESTFIELD_PARALLEL_H
+#define WESTFIELD_PARALLEL_H
+
+#include <stdint.h>
+
+/*
+ * Processes rows [first_row, last_row). Returns 0 on success.
+ */
+typedef int (*westfield_rows_func_t)(void *data, int32_t first_row, int32_t last_row);
+
+/*
+ * Splits rows in bands that are processed on up to max_threads threads, including the calling thread. The other threads
+ * come from a pool of workers that is shared by all callers and kept around between calls. Small amounts of work,
+ * expressed in pixels, are not worth a thread and are processed on the calling thread only. Bands that no worker
+ * picked up yet, eg. because all of them are busy or could not be started, are processed on the calling thread.
+ *
+ * Returns 0 if all bands succeeded.
+ */
+int
+westfield_parallel_rows(int32_t rows, int64_t pixels, int max_threads, westfield_rows_func_t rows_func, void *data);
+
+#endif //WESTFIELD_PARALLEL_H
@@ -0,0 +1,102 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "wayland-server-core-extensions.h"
+#include "westfield-process.h"
+
+// how often to check on a child when there is no pidfd to wait on
+#define POLL_INTERVAL_MS 500
+// how often to check on a child that was asked to terminate
+#define TERMINATE_POLL_INTERVAL_MS 10
+
+static int
+process_reap(struct westfield_process *process) {
+    int status;
+    pid_t pid;
+
+    do {
+        pid = waitpid(process->pid, &status, WNOHANG);
+    } while (pid < 0 && errno == EINTR);
+    if (pid == 0) {
+        return 0;
+    }
+
+    wl_event_source_remove(process->source);
+    process->source = NULL;
+    // someone else reaped it, there is no status to report
+    if (pid < 0) {
+        status = 0;
+    }
+    process->cleanup(process, status);
+    return 1;
+}
+
+static int
+handle_pidfd(int fd, uint32_t mask, void *data) {
+    process_reap(data);
+    return 0;
+}
+
+static int
+handle_poll_timer(void *data) {
+    struct westfield_process *process = data;
+    struct wl_event_source *source = process->source;
+
+    if (!process_reap(process)) {
+        wl_event_source_timer_update(source, POLL_INTERVAL_MS);
+    }
+    return 0;
+}
+
+int
+westfield_process_watch(struct wl_event_loop *loop, struct westfield_process *process) {
+    int pidfd = (int) syscall(SYS_pidfd_open, process->pid, 0);
+
+    if (pidfd >= 0) {
+        // the event source uses a dup of the fd
+        process->source = wl_event_loop_add_fd(loop, pidfd, WL_EVENT_READABLE, handle_pidfd, process);
+        close(pidfd);
+    } else {
+        process->source = wl_event_loop_add_timer(loop, handle_poll_timer, process);
+        if (process->source) {
+            wl_event_source_timer_update(process->source, POLL_INTERVAL_MS);
+        }
+    }
+
+    return process->source ? 0 : -1;
+}
+
+void
+westfield_process_unwatch(struct westfield_process *process) {
+    if (process->source) {
+        wl_event_source_remove(process->source);
+        process->source = NULL;
+    }
+}
+
+void
+westfield_process_terminate(struct westfield_process *process, int timeout_ms) {
+    const struct timespec interval = {0, TERMINATE_POLL_INTERVAL_MS * 1000000};
+    pid_t pid;
+
+    westfield_process_unwatch(process);
+    kill(process->pid, SIGTERM);
+    for (int waited_ms = 0; waited_ms < timeout_ms; waited_ms += TERMINATE_POLL_INTERVAL_MS) {
+        pid = waitpid(process->pid, NULL, WNOHANG);
+        // reaped, or not our child to begin with
+        if (pid > 0 || (pid < 0 && errno != EINTR)) {
+            return;
+        }
+        nanosleep(&interval, NULL);
+    }
+
+    kill(process->pid, SIGKILL);
+    do {
+        pid = waitpid(process->pid, NULL, 0);
+    } while (pid < 0 && errno == EINTR);
+}
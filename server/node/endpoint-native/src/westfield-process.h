@@ -0,0 +1,46 @@
+//
+// Child processes that are reaped from the wayland event loop.
+//
+
+#ifndef WESTFIELD_PROCESS_H
+#define WESTFIELD_PROCESS_H
+
+#include <sys/types.h>
+
+struct wl_event_loop;
+struct wl_event_source;
+struct westfield_process;
+
+/*
+ * Called from the event loop once the process has exited and was reaped. status is as returned by waitpid.
+ */
+typedef void (*westfield_process_cleanup_func_t)(struct westfield_process *process, int status);
+
+struct westfield_process {
+    pid_t pid;
+    westfield_process_cleanup_func_t cleanup;
+    struct wl_event_source *source;
+};
+
+/*
+ * Watches a child process through a pidfd, so its exit is handled in the same dispatch as any other event source. No
+ * signal handler is involved, which would get in the way of the one libuv installs for its own children. On kernels
+ * without pidfd_open the process is polled instead. Returns -1 on error.
+ */
+int
+westfield_process_watch(struct wl_event_loop *loop, struct westfield_process *process);
+
+/*
+ * Stops watching the process without reaping it. Its cleanup is not called.
+ */
+void
+westfield_process_unwatch(struct westfield_process *process);
+
+/*
+ * Stops watching the process, asks it to terminate and reaps it, so it does not linger as a zombie. A process that did
+ * not exit after timeout_ms is killed. Blocks until it is gone. Its cleanup is not called.
+ */
+void
+westfield_process_terminate(struct westfield_process *process, int timeout_ms);
+
+#endif //WESTFIELD_PROCESS_H
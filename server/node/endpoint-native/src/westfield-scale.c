@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "westfield-parallel.h"
+#include "westfield-scale.h"
+
+struct scale_job {
+    const uint8_t *src;
+    int32_t src_width;
+    int32_t src_height;
+    int32_t src_stride;
+    uint32_t *dst;
+    int32_t dst_width;
+    int32_t dst_height;
+    // first and one past the last source column of each destination column
+    int32_t *column_start;
+    int32_t *column_end;
+};
+
+static void
+box_range(int32_t index, int32_t src_size, int32_t dst_size, int32_t *start, int32_t *end) {
+    *start = (int32_t) (((int64_t) index * src_size) / dst_size);
+    *end = (int32_t) (((int64_t) (index + 1) * src_size) / dst_size);
+    if (*end <= *start) {
+        *end = *start + 1;
+    }
+}
+
+// adds each channel of a row of pixels to the matching 64 bit column sum, a box can be taller than 32 bits can count
+static void
+accumulate_row(uint64_t *sums, const uint8_t *row, int32_t width) {
+    int32_t x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 4 <= width; x += 4) {
+        const __m128i pixels = _mm_loadu_si128((const __m128i *) (row + x * 4));
+        const __m128i low = _mm_unpacklo_epi8(pixels, zero);
+        const __m128i high = _mm_unpackhi_epi8(pixels, zero);
+        const __m128i channels[4] = {
+                _mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero),
+                _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero)
+        };
+        __m128i *sum = (__m128i *) (sums + x * 4);
+
+        for (int i = 0; i < 4; i++) {
+            _mm_storeu_si128(sum + i * 2, _mm_add_epi64(_mm_loadu_si128(sum + i * 2),
+                                                        _mm_unpacklo_epi32(channels[i], zero)));
+            _mm_storeu_si128(sum + i * 2 + 1, _mm_add_epi64(_mm_loadu_si128(sum + i * 2 + 1),
+                                                            _mm_unpackhi_epi32(channels[i], zero)));
+        }
+    }
+#endif
+    for (x *= 4; x < width * 4; x++) {
+        sums[x] += row[x];
+    }
+}
+
+static int
+scale_rows(void *data, int32_t first_row, int32_t last_row) {
+    const struct scale_job *job = data;
+    uint64_t *sums = malloc((size_t) job->src_width * 4 * sizeof(uint64_t));
+    if (sums == NULL) {
+        return -1;
+    }
+
+    for (int32_t dst_y = first_row; dst_y < last_row; dst_y++) {
+        int32_t src_y, src_y_end;
+        uint8_t *dst_row = (uint8_t *) (job->dst + (size_t) dst_y * job->dst_width);
+
+        box_range(dst_y, job->src_height, job->dst_height, &src_y, &src_y_end);
+        memset(sums, 0, (size_t) job->src_width * 4 * sizeof(uint64_t));
+        for (int32_t y = src_y; y < src_y_end; y++) {
+            accumulate_row(sums, job->src + (size_t) y * job->src_stride, job->src_width);
+        }
+
+        for (int32_t dst_x = 0; dst_x < job->dst_width; dst_x++) {
+            const int32_t start = job->column_start[dst_x];
+            const int32_t end = job->column_end[dst_x];
+            const uint64_t count = (uint64_t) (end - start) * (uint64_t) (src_y_end - src_y);
+            uint64_t channels[4] = {0, 0, 0, 0};
+
+            for (int32_t x = start; x < end; x++) {
+                channels[0] += sums[x * 4];
+                channels[1] += sums[x * 4 + 1];
+                channels[2] += sums[x * 4 + 2];
+                channels[3] += sums[x * 4 + 3];
+            }
+            for (int c = 0; c < 4; c++) {
+                dst_row[dst_x * 4 + c] = (uint8_t) ((channels[c] + count / 2) / count);
+            }
+        }
+    }
+
+    free(sums);
+    return 0;
+}
+
+int
+westfield_box_scale(const uint8_t *src, int32_t src_width, int32_t src_height, int32_t src_stride,
+                    uint32_t *dst, int32_t dst_width, int32_t dst_height, int max_threads) {
+    struct scale_job job = {
+            .src = src,
+            .src_width = src_width,
+            .src_height = src_height,
+            .src_stride = src_stride,
+            .dst = dst,
+            .dst_width = dst_width,
+            .dst_height = dst_height,
+    };
+    int result;
+
+    job.column_start = malloc((size_t) dst_width * 2 * sizeof(int32_t));
+    if (job.column_start == NULL) {
+        return -1;
+    }
+    job.column_end = job.column_start + dst_width;
+    for (int32_t dst_x = 0; dst_x < dst_width; dst_x++) {
+        box_range(dst_x, src_width, dst_width, &job.column_start[dst_x], &job.column_end[dst_x]);
+    }
+
+    result = westfield_parallel_rows(dst_height, (int64_t) src_width * src_height, max_threads, scale_rows, &job);
+
+    free(job.column_start);
+    return result;
+}
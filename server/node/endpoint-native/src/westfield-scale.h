@@ -0,0 +1,22 @@
+//
+// Box filter scaling of 32 bit pixel buffers, used for surface previews.
+//
+
+#ifndef WESTFIELD_SCALE_H
+#define WESTFIELD_SCALE_H
+
+#include <stdint.h>
+
+/*
+ * Scales a 32 bit per pixel source to a tightly packed destination by averaging each channel over the source pixels
+ * that are covered by a destination pixel. The channel order is kept as is. When scaling up, source pixels are
+ * repeated. Large sources are split in bands of destination rows that are scaled on up to max_threads threads,
+ * including the calling thread.
+ *
+ * Returns 0 on success, -1 if memory could not be allocated.
+ */
+int
+westfield_box_scale(const uint8_t *src, int32_t src_width, int32_t src_height, int32_t src_stride,
+                    uint32_t *dst, int32_t dst_width, int32_t dst_height, int max_threads);
+
+#endif //WESTFIELD_SCALE_H
@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <string.h>
+#include "westfield-hash.h"
+#include "westfield-scroll.h"
+
+// rows per block of column hashes
+#define BLOCK_ROWS 16
+// a shift needs this many matching rows or columns in a single run
+#define MIN_RUN 16
+#define COLUMN_PRIME 0x9E3779B185EBCA87ULL
+#define EMPTY_INDEX (-1)
+#define DUPLICATE_INDEX (-2)
+
+// a run of lines where next[i] == previous[i - offset]
+struct shift {
+    int32_t offset;
+    int32_t start;
+    int32_t end;
+};
+
+struct westfield_scroll_detector *
+westfield_scroll_detector_create(void) {
+    return calloc(1, sizeof(struct westfield_scroll_detector));
+}
+
+static void
+free_frame_state(struct westfield_scroll_detector *detector) {
+    free(detector->row_hashes);
+    free(detector->next_row_hashes);
+    free(detector->column_hashes);
+    free(detector->next_column_hashes);
+    free(detector->band_hashes);
+    free(detector->next_band_hashes);
+    free(detector->votes);
+    free(detector->index_keys);
+    free(detector->index_values);
+}
+
+void
+westfield_scroll_detector_destroy(struct westfield_scroll_detector *detector) {
+    free_frame_state(detector);
+    free(detector);
+}
+
+static int
+ensure_frame_size(struct westfield_scroll_detector *detector, int32_t width, int32_t height) {
+    const int32_t blocks = (height + BLOCK_ROWS - 1) / BLOCK_ROWS;
+    const int32_t lines = width > height ? width : height;
+    uint32_t index_size = 1;
+
+    if (detector->row_hashes && detector->width == width && detector->height == height) {
+        return 0;
+    }
+
+    free_frame_state(detector);
+    memset(detector, 0, sizeof(struct westfield_scroll_detector));
+
+    while (index_size < (uint32_t) lines * 2) {
+        index_size <<= 1;
+    }
+    detector->row_hashes = malloc((size_t) height * sizeof(uint64_t));
+    detector->next_row_hashes = malloc((size_t) height * sizeof(uint64_t));
+    detector->column_hashes = malloc((size_t) blocks * width * sizeof(uint64_t));
+    detector->next_column_hashes = malloc((size_t) blocks * width * sizeof(uint64_t));
+    detector->band_hashes = malloc((size_t) width * sizeof(uint64_t));
+    detector->next_band_hashes = malloc((size_t) width * sizeof(uint64_t));
+    detector->votes = malloc((size_t) lines * 2 * sizeof(int32_t));
+    detector->index_keys = malloc((size_t) index_size * sizeof(uint64_t));
+    detector->index_values = malloc((size_t) index_size * sizeof(int32_t));
+    if (detector->row_hashes == NULL || detector->next_row_hashes == NULL || detector->column_hashes == NULL ||
+        detector->next_column_hashes == NULL || detector->band_hashes == NULL || detector->next_band_hashes == NULL ||
+        detector->votes == NULL || detector->index_keys == NULL || detector->index_values == NULL) {
+        free_frame_state(detector);
+        memset(detector, 0, sizeof(struct westfield_scroll_detector));
+        return -1;
+    }
+    detector->index_mask = index_size - 1;
+    detector->width = width;
+    detector->height = height;
+    return 0;
+}
+
+static void
+hash_frame(struct westfield_scroll_detector *detector, const uint8_t *pixels, int32_t stride) {
+    const int32_t width = detector->width;
+
+    for (int32_t y = 0; y < detector->height; y++) {
+        const uint32_t *row = (const uint32_t *) (pixels + (size_t) y * stride);
+        uint64_t *column_hashes = detector->next_column_hashes + (size_t) (y / BLOCK_ROWS) * width;
+        struct westfield_hash_state state;
+
+        westfield_hash_init(&state, 0);
+        westfield_hash_update(&state, (const uint8_t *) row, (size_t) width * 4);
+        detector->next_row_hashes[y] = westfield_hash_digest(&state);
+
+        if (y % BLOCK_ROWS == 0) {
+            memset(column_hashes, 0, (size_t) width * sizeof(uint64_t));
+        }
+        for (int32_t x = 0; x < width; x++) {
+            column_hashes[x] = (column_hashes[x] ^ row[x]) * COLUMN_PRIME;
+        }
+    }
+}
+
+static uint32_t
+index_slot(uint64_t hash, uint32_t mask) {
+    return (uint32_t) (hash ^ (hash >> 29)) & mask;
+}
+
+/*
+ * Finds the offset that most lines that changed in place agree on, then the longest run of lines that match with that
+ * offset. Lines that occur more than once in the previous frame, eg. empty lines, can't tell their offset and don't
+ * vote.
+ */
+static bool
+find_shift(struct westfield_scroll_detector *detector, const uint64_t *previous, const uint64_t *next, int32_t count,
+           struct shift *shift) {
+    int32_t best_offset = 0, best_votes = 0;
+
+    memset(detector->index_values, 0xff, (size_t) (detector->index_mask + 1) * sizeof(int32_t));
+    for (int32_t i = 0; i < count; i++) {
+        uint32_t slot = index_slot(previous[i], detector->index_mask);
+        while (detector->index_values[slot] != EMPTY_INDEX && detector->index_keys[slot] != previous[i]) {
+            slot = (slot + 1) & detector->index_mask;
+        }
+        if (detector->index_values[slot] == EMPTY_INDEX) {
+            detector->index_keys[slot] = previous[i];
+            detector->index_values[slot] = i;
+        } else {
+            detector->index_values[slot] = DUPLICATE_INDEX;
+        }
+    }
+
+    memset(detector->votes, 0, (size_t) count * 2 * sizeof(int32_t));
+    for (int32_t i = 0; i < count; i++) {
+        uint32_t slot;
+        if (next[i] == previous[i]) {
+            continue;
+        }
+        slot = index_slot(next[i], detector->index_mask);
+        while (detector->index_values[slot] != EMPTY_INDEX && detector->index_keys[slot] != next[i]) {
+            slot = (slot + 1) & detector->index_mask;
+        }
+        if (detector->index_values[slot] >= 0) {
+            const int32_t offset = i - detector->index_values[slot];
+            if (++detector->votes[offset + count] > best_votes) {
+                best_votes = detector->votes[offset + count];
+                best_offset = offset;
+            }
+        }
+    }
+    if (best_offset == 0) {
+        return false;
+    }
+
+    shift->offset = best_offset;
+    shift->start = shift->end = 0;
+    for (int32_t i = best_offset > 0 ? best_offset : 0, run_start = i; i <= count && i - best_offset <= count; i++) {
+        if (i < count && i - best_offset < count && next[i] == previous[i - best_offset]) {
+            continue;
+        }
+        if (i - run_start > shift->end - shift->start) {
+            shift->start = run_start;
+            shift->end = i;
+        }
+        run_start = i + 1;
+    }
+    return shift->end - shift->start >= MIN_RUN;
+}
+
+static void
+add_exposed(struct westfield_scroll_result *result, int32_t x, int32_t y, int32_t width, int32_t height) {
+    struct westfield_rect *last;
+
+    if (result->exposed_count < WESTFIELD_SCROLL_MAX_EXPOSED_RECTS) {
+        result->exposed[result->exposed_count++] = (struct westfield_rect) {x, y, width, height};
+        return;
+    }
+    // out of rects, grow the last one so it also covers this one. Lines are added in order.
+    last = &result->exposed[WESTFIELD_SCROLL_MAX_EXPOSED_RECTS - 1];
+    if (y == last->y && height == last->height) {
+        last->width = x + width - last->x;
+    } else {
+        last->height = y + height - last->y;
+    }
+}
+
+// adds each run of lines in [start, end) that differ from the previous frame, ignoring the lines of the shift
+static void
+add_changed_lines(struct westfield_scroll_result *result, const uint64_t *previous, const uint64_t *next,
+                  int32_t start, int32_t end, const struct shift *shift, bool columns, const struct westfield_rect *band) {
+    int32_t run_start = -1;
+
+    for (int32_t i = start; i <= end; i++) {
+        const bool changed = i < end && (shift == NULL || i < shift->start || i >= shift->end) &&
+                             next[i] != previous[i];
+        if (changed && run_start < 0) {
+            run_start = i;
+        } else if (!changed && run_start >= 0) {
+            if (columns) {
+                add_exposed(result, run_start, band->y, i - run_start, band->height);
+            } else {
+                add_exposed(result, band->x, run_start, band->width, i - run_start);
+            }
+            run_start = -1;
+        }
+    }
+}
+
+static void
+detect_horizontal(struct westfield_scroll_detector *detector, int32_t first_changed_row, int32_t last_changed_row,
+                  struct westfield_scroll_result *result) {
+    const int32_t width = detector->width;
+    const int32_t first_block = first_changed_row / BLOCK_ROWS;
+    const int32_t end_block = last_changed_row / BLOCK_ROWS + 1;
+    const int32_t band_end = end_block * BLOCK_ROWS < detector->height ? end_block * BLOCK_ROWS : detector->height;
+    const struct westfield_rect band = {0, first_block * BLOCK_ROWS, width, band_end - first_block * BLOCK_ROWS};
+    struct shift shift;
+
+    // column hashes of the changed band, built from whole blocks
+    memset(detector->band_hashes, 0, (size_t) width * sizeof(uint64_t));
+    memset(detector->next_band_hashes, 0, (size_t) width * sizeof(uint64_t));
+    for (int32_t block = first_block; block < end_block; block++) {
+        const uint64_t *previous = detector->column_hashes + (size_t) block * width;
+        const uint64_t *next = detector->next_column_hashes + (size_t) block * width;
+        for (int32_t x = 0; x < width; x++) {
+            detector->band_hashes[x] = (detector->band_hashes[x] ^ previous[x]) * COLUMN_PRIME;
+            detector->next_band_hashes[x] = (detector->next_band_hashes[x] ^ next[x]) * COLUMN_PRIME;
+        }
+    }
+
+    if (find_shift(detector, detector->band_hashes, detector->next_band_hashes, width, &shift)) {
+        result->scrolled = true;
+        result->dx = shift.offset;
+        result->dy = 0;
+        result->copy = (struct westfield_rect) {shift.start - shift.offset, band.y, shift.end - shift.start,
+                                                band.height};
+        add_changed_lines(result, detector->band_hashes, detector->next_band_hashes, 0, width, &shift, true, &band);
+    } else {
+        add_changed_lines(result, detector->row_hashes, detector->next_row_hashes, first_changed_row,
+                          last_changed_row + 1, NULL, false, &(struct westfield_rect) {0, 0, width, 0});
+    }
+}
+
+static void
+swap_frames(struct westfield_scroll_detector *detector) {
+    uint64_t *swap;
+
+    swap = detector->row_hashes;
+    detector->row_hashes = detector->next_row_hashes;
+    detector->next_row_hashes = swap;
+    swap = detector->column_hashes;
+    detector->column_hashes = detector->next_column_hashes;
+    detector->next_column_hashes = swap;
+}
+
+int
+westfield_scroll_detector_detect(struct westfield_scroll_detector *detector, const uint8_t *pixels, int32_t width,
+                                 int32_t height, int32_t stride, struct westfield_scroll_result *result) {
+    const struct westfield_rect full_width = {0, 0, width, 0};
+    int32_t first_changed_row = -1, last_changed_row = -1;
+    struct shift shift;
+    memset(result, 0, sizeof(struct westfield_scroll_result));
+    if (ensure_frame_size(detector, width, height)) {
+        return -1;
+    }
+    hash_frame(detector, pixels, stride);
+
+    if (!detector->has_frame) {
+        add_exposed(result, 0, 0, width, height);
+    } else if (find_shift(detector, detector->row_hashes, detector->next_row_hashes, height, &shift)) {
+        result->scrolled = true;
+        result->dx = 0;
+        result->dy = shift.offset;
+        result->copy = (struct westfield_rect) {0, shift.start - shift.offset, width, shift.end - shift.start};
+        add_changed_lines(result, detector->row_hashes, detector->next_row_hashes, 0, height, &shift, false,
+                          &full_width);
+    } else {
+        for (int32_t y = 0; y < height; y++) {
+            if (detector->next_row_hashes[y] != detector->row_hashes[y]) {
+                if (first_changed_row < 0) {
+                    first_changed_row = y;
+                }
+                last_changed_row = y;
+            }
+        }
+        if (first_changed_row >= 0) {
+            detect_horizontal(detector, first_changed_row, last_changed_row, result);
+        }
+    }
+
+    swap_frames(detector);
+    detector->had_frame = detector->has_frame;
+    detector->has_frame = true;
+    return 0;
+}
+
+void
+westfield_scroll_detector_revert(struct westfield_scroll_detector *detector) {
+    swap_frames(detector);
+    detector->has_frame = detector->had_frame;
+}
@@ -0,0 +1,76 @@
+//
+// Detection of scrolled content between successive 32 bit frames of a surface.
+//
+
+#ifndef WESTFIELD_SCROLL_H
+#define WESTFIELD_SCROLL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WESTFIELD_SCROLL_MAX_EXPOSED_RECTS 16
+
+struct westfield_rect {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+};
+
+struct westfield_scroll_result {
+    // the source rectangle of the previous frame that is found at (x + dx, y + dy) in the new frame
+    bool scrolled;
+    struct westfield_rect copy;
+    int32_t dx;
+    int32_t dy;
+    // the parts of the new frame that differ from the previous frame after the copy was applied
+    struct westfield_rect exposed[WESTFIELD_SCROLL_MAX_EXPOSED_RECTS];
+    int exposed_count;
+};
+
+struct westfield_scroll_detector {
+    int32_t width;
+    int32_t height;
+    bool has_frame;
+    // has_frame before the last detection, to revert it
+    bool had_frame;
+    // of the previous and the new frame, swapped after each detection
+    uint64_t *row_hashes;
+    uint64_t *next_row_hashes;
+    // a hash of each column of each block of rows, so a horizontal shift can be searched in the changed rows only
+    uint64_t *column_hashes;
+    uint64_t *next_column_hashes;
+    // scratch space for finding shifts
+    uint64_t *band_hashes;
+    uint64_t *next_band_hashes;
+    int32_t *votes;
+    uint64_t *index_keys;
+    int32_t *index_values;
+    uint32_t index_mask;
+};
+
+struct westfield_scroll_detector *
+westfield_scroll_detector_create(void);
+
+void
+westfield_scroll_detector_destroy(struct westfield_scroll_detector *detector);
+
+/*
+ * Compares a frame with the one passed to the previous call. The first frame, or a frame of a different size, is
+ * reported as fully exposed.
+ *
+ * Returns 0 on success, -1 on allocation failure.
+ */
+int
+westfield_scroll_detector_detect(struct westfield_scroll_detector *detector, const uint8_t *pixels, int32_t width,
+                                 int32_t height, int32_t stride, struct westfield_scroll_result *result);
+
+/*
+ * Forgets the frame passed to the last successful detection, eg. because its contents turned out to be unreadable. The
+ * next detection compares with the frame before it again, or reports a full exposure if the size changed in between.
+ * Must directly follow that detection.
+ */
+void
+westfield_scroll_detector_revert(struct westfield_scroll_detector *detector);
+
+#endif //WESTFIELD_SCROLL_H
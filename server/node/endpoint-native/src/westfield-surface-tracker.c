@@ -0,0 +1,751 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "connection.h"
+#include "wayland-server-core-extensions.h"
+#include "westfield-surface-tracker.h"
+
+#define WL_DISPLAY_ID 1
+#define WL_DISPLAY_DELETE_ID 1
+#define WL_REGISTRY_BIND 0
+#define WL_COMPOSITOR_CREATE_SURFACE 0
+#define WL_SURFACE_DESTROY 0
+#define WL_SURFACE_ATTACH 1
+#define WL_SURFACE_DAMAGE 2
+#define WL_SURFACE_FRAME 3
+#define WL_SURFACE_COMMIT 6
+#define WL_SURFACE_SET_BUFFER_TRANSFORM 7
+#define WL_SURFACE_SET_BUFFER_SCALE 8
+#define WL_SURFACE_DAMAGE_BUFFER 9
+#define WL_CALLBACK_DONE 0
+#define WL_BUFFER_DESTROY 0
+#define WL_BUFFER_RELEASE 0
+
+// don't let a misbehaving client make us allocate for arbitrary object ids
+#define MAX_ID_GAP 4096
+
+enum tracked_kind {
+    TRACKED_NONE = 0,
+    TRACKED_REGISTRY,
+    TRACKED_COMPOSITOR,
+    TRACKED_SURFACE,
+    TRACKED_FRAME_CALLBACK,
+    TRACKED_BUFFER,
+};
+
+struct tracked_surface {
+    uint32_t id;
+    bool has_frame_interval;
+    uint32_t frame_interval_ms;
+    uint64_t last_done_ms;
+    // incremented each time the held events are written out
+    uint32_t releases;
+    // held back events, as uint32 words
+    struct wl_array held_events;
+    // in westfield_surface_tracker.held_surfaces while there are held events
+    struct wl_list link;
+    // double buffered state, applied on commit
+    struct westfield_surface_commit pending;
+};
+
+struct tracked_object {
+    enum tracked_kind kind;
+    // set for surfaces
+    struct tracked_surface *surface;
+    // set for frame callbacks
+    uint32_t surface_id;
+    bool held;
+    // the surface releases count at the time the done event was held
+    uint32_t held_at;
+    // set for buffers that were committed and not released yet
+    bool buffer_held;
+    uint64_t buffer_held_since_ms;
+    // holds of a buffer are numbered, this is the number of the current or last one
+    uint32_t buffer_hold_serial;
+    // the last hold that JS sent a release for, JS releases holds in order
+    uint32_t buffer_js_release_serial;
+};
+
+struct westfield_surface_tracker {
+    struct wl_client *client;
+    // indexed by client object id
+    struct tracked_object *objects;
+    uint32_t objects_size;
+    uint32_t frame_interval_ms;
+    struct wl_event_source *frame_timer;
+    struct wl_list held_surfaces;
+    westfield_surface_commit_t commit_listener;
+    void *commit_listener_data;
+    bool auto_release;
+    bool id_gap_logged;
+    struct westfield_buffer_stats buffer_stats;
+};
+
+static uint64_t
+now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+static struct tracked_object *
+lookup(struct westfield_surface_tracker *tracker, uint32_t id) {
+    return id < tracker->objects_size ? &tracker->objects[id] : NULL;
+}
+
+static struct tracked_object *
+track(struct westfield_surface_tracker *tracker, uint32_t id) {
+    if (id >= tracker->objects_size) {
+        uint32_t size = tracker->objects_size ? tracker->objects_size : 64;
+        struct tracked_object *objects;
+
+        if (id > tracker->objects_size + MAX_ID_GAP) {
+            if (!tracker->id_gap_logged) {
+                printf("Surface tracker ignores object id %u of client %p, it is too far beyond the ids seen so far. "
+                       "Not logging further ids.\n", id, (void *) tracker->client);
+                tracker->id_gap_logged = true;
+            }
+            return NULL;
+        }
+        while (size <= id) {
+            size *= 2;
+        }
+        objects = realloc(tracker->objects, size * sizeof(struct tracked_object));
+        if (objects == NULL) {
+            return NULL;
+        }
+        memset(objects + tracker->objects_size, 0, (size - tracker->objects_size) * sizeof(struct tracked_object));
+        tracker->objects = objects;
+        tracker->objects_size = size;
+    }
+    return &tracker->objects[id];
+}
+
+static void
+destroy_surface(struct westfield_surface_tracker *tracker, struct tracked_object *object);
+
+static void
+buffer_released(struct westfield_surface_tracker *tracker, struct tracked_object *buffer);
+
+// like track but for an object the client just created, anything we knew about the id before is gone
+static struct tracked_object *
+track_new(struct westfield_surface_tracker *tracker, uint32_t id) {
+    struct tracked_object *object = track(tracker, id);
+    if (object && object->kind == TRACKED_SURFACE) {
+        destroy_surface(tracker, object);
+    }
+    if (object && object->kind == TRACKED_BUFFER && object->buffer_held) {
+        buffer_released(tracker, object);
+    }
+    if (object) {
+        object->kind = TRACKED_NONE;
+        object->held = false;
+    }
+    return object;
+}
+
+static struct tracked_surface *
+lookup_surface(struct westfield_surface_tracker *tracker, uint32_t surface_id) {
+    struct tracked_object *object = lookup(tracker, surface_id);
+    return object && object->kind == TRACKED_SURFACE ? object->surface : NULL;
+}
+
+static uint32_t
+frame_interval(struct westfield_surface_tracker *tracker, struct tracked_surface *surface) {
+    return surface->has_frame_interval ? surface->frame_interval_ms : tracker->frame_interval_ms;
+}
+
+static void
+hold_event(struct westfield_surface_tracker *tracker, struct tracked_surface *surface, const uint32_t *message,
+           size_t size) {
+    void *held = wl_array_add(&surface->held_events, size);
+    if (held) {
+        memcpy(held, message, size);
+    }
+    if (wl_list_empty(&surface->link)) {
+        wl_list_insert(tracker->held_surfaces.prev, &surface->link);
+    }
+}
+
+static void
+release_held_events(struct westfield_surface_tracker *tracker, struct tracked_surface *surface, uint64_t now) {
+    wl_connection_write(wl_client_get_connection(tracker->client), surface->held_events.data,
+                        surface->held_events.size);
+    surface->held_events.size = 0;
+    surface->releases++;
+    surface->last_done_ms = now;
+    wl_list_remove(&surface->link);
+    wl_list_init(&surface->link);
+}
+
+static void
+schedule_frame_timer(struct westfield_surface_tracker *tracker, uint64_t delay_ms) {
+    // a timeout of 0 disarms the timer
+    wl_event_source_timer_update(tracker->frame_timer, delay_ms ? (int) delay_ms : 1);
+}
+
+static int
+on_frame_timer(void *data) {
+    struct westfield_surface_tracker *tracker = data;
+    struct tracked_surface *surface, *next;
+    const uint64_t now = now_ms();
+    uint64_t next_delay = 0;
+    bool released = false;
+
+    wl_list_for_each_safe(surface, next, &tracker->held_surfaces, link) {
+        const uint32_t interval = frame_interval(tracker, surface);
+        const uint64_t elapsed = now - surface->last_done_ms;
+        if (elapsed >= interval) {
+            release_held_events(tracker, surface, now);
+            released = true;
+        } else if (next_delay == 0 || interval - elapsed < next_delay) {
+            next_delay = interval - elapsed;
+        }
+    }
+
+    if (released) {
+        wl_client_flush(tracker->client);
+    }
+    if (next_delay) {
+        schedule_frame_timer(tracker, next_delay);
+    }
+    return 0;
+}
+
+static void
+destroy_surface(struct westfield_surface_tracker *tracker, struct tracked_object *object) {
+    struct tracked_surface *surface = object->surface;
+
+    // nothing left to throttle, let the client have its callbacks
+    if (surface->held_events.size) {
+        release_held_events(tracker, surface, now_ms());
+    }
+    wl_list_remove(&surface->link);
+    wl_array_release(&surface->held_events);
+    free(surface);
+    object->kind = TRACKED_NONE;
+    object->surface = NULL;
+}
+
+struct westfield_surface_tracker *
+westfield_surface_tracker_create(struct wl_client *client) {
+    struct westfield_surface_tracker *tracker = calloc(1, sizeof(struct westfield_surface_tracker));
+    if (tracker == NULL) {
+        return NULL;
+    }
+    tracker->client = client;
+    wl_list_init(&tracker->held_surfaces);
+    // the frame timer is only created once a frame rate cap is set
+    return tracker;
+}
+
+void
+westfield_surface_tracker_destroy(struct westfield_surface_tracker *tracker) {
+    for (uint32_t id = 0; id < tracker->objects_size; id++) {
+        struct tracked_object *object = &tracker->objects[id];
+        if (object->kind == TRACKED_SURFACE) {
+            wl_list_remove(&object->surface->link);
+            wl_array_release(&object->surface->held_events);
+            free(object->surface);
+        }
+    }
+    free(tracker->objects);
+    if (tracker->frame_timer) {
+        wl_event_source_remove(tracker->frame_timer);
+    }
+    free(tracker);
+}
+
+void
+westfield_surface_tracker_registry_created(struct westfield_surface_tracker *tracker, uint32_t registry_id) {
+    struct tracked_object *object = track(tracker, registry_id);
+    if (object) {
+        object->kind = TRACKED_REGISTRY;
+    }
+}
+
+static void
+registry_request(struct westfield_surface_tracker *tracker, const uint32_t *wire_message, size_t words,
+                 uint32_t opcode) {
+    // bind(name: uint, interface: string, version: uint, id: new_id)
+    static const char compositor_name[] = "wl_compositor";
+    struct tracked_object *object;
+    uint32_t interface_length, interface_words;
+
+    if (opcode != WL_REGISTRY_BIND || words < 4) {
+        return;
+    }
+    interface_length = wire_message[3];
+    interface_words = (interface_length + 3) / 4;
+    if (words < 6 + interface_words || interface_length != sizeof(compositor_name) ||
+        memcmp(&wire_message[4], compositor_name, sizeof(compositor_name)) != 0) {
+        return;
+    }
+
+    object = track_new(tracker, wire_message[5 + interface_words]);
+    if (object) {
+        object->kind = TRACKED_COMPOSITOR;
+    }
+}
+
+static void
+compositor_request(struct westfield_surface_tracker *tracker, const uint32_t *wire_message, size_t words,
+                   uint32_t opcode) {
+    struct tracked_object *object;
+    struct tracked_surface *surface;
+
+    if (opcode != WL_COMPOSITOR_CREATE_SURFACE || words < 3) {
+        return;
+    }
+    object = track_new(tracker, wire_message[2]);
+    if (object == NULL) {
+        return;
+    }
+    surface = calloc(1, sizeof(struct tracked_surface));
+    if (surface == NULL) {
+        return;
+    }
+    surface->id = wire_message[2];
+    surface->pending.scale = 1;
+    wl_array_init(&surface->held_events);
+    wl_list_init(&surface->link);
+    object->kind = TRACKED_SURFACE;
+    object->surface = surface;
+}
+
+static void
+buffer_held(struct westfield_surface_tracker *tracker, uint32_t buffer_id) {
+    struct tracked_object *buffer = lookup(tracker, buffer_id);
+    struct westfield_buffer_stats *stats = &tracker->buffer_stats;
+
+    if (buffer == NULL || buffer->kind != TRACKED_BUFFER) {
+        return;
+    }
+    stats->commits++;
+    if (buffer->buffer_held) {
+        // committed again before it was released, it's still the same hold
+        return;
+    }
+    buffer->buffer_held = true;
+    buffer->buffer_held_since_ms = now_ms();
+    buffer->buffer_hold_serial++;
+    if (++stats->held > stats->max_held) {
+        stats->max_held = stats->held;
+    }
+}
+
+static void
+buffer_released(struct westfield_surface_tracker *tracker, struct tracked_object *buffer) {
+    struct westfield_buffer_stats *stats = &tracker->buffer_stats;
+    const uint64_t hold_ms = now_ms() - buffer->buffer_held_since_ms;
+
+    buffer->buffer_held = false;
+    stats->held--;
+    stats->releases++;
+    stats->total_hold_ms += hold_ms;
+    if (hold_ms > stats->max_hold_ms) {
+        stats->max_hold_ms = hold_ms;
+    }
+}
+
+static void
+buffer_request(struct westfield_surface_tracker *tracker, struct tracked_object *buffer, uint32_t opcode) {
+    if (opcode == WL_BUFFER_DESTROY) {
+        // a destroyed buffer is no longer held either, whether it was released or not
+        if (buffer->buffer_held) {
+            buffer_released(tracker, buffer);
+        }
+        buffer->kind = TRACKED_NONE;
+    }
+}
+
+static int64_t
+rect_area(const struct westfield_damage_rect *rect) {
+    return (int64_t) rect->width * rect->height;
+}
+
+static struct westfield_damage_rect
+rect_union(const struct westfield_damage_rect *a, const struct westfield_damage_rect *b) {
+    const int32_t x1 = a->x < b->x ? a->x : b->x;
+    const int32_t y1 = a->y < b->y ? a->y : b->y;
+    const int64_t a_x2 = (int64_t) a->x + a->width, b_x2 = (int64_t) b->x + b->width;
+    const int64_t a_y2 = (int64_t) a->y + a->height, b_y2 = (int64_t) b->y + b->height;
+    const int64_t x2 = a_x2 > b_x2 ? a_x2 : b_x2;
+    const int64_t y2 = a_y2 > b_y2 ? a_y2 : b_y2;
+    const struct westfield_damage_rect result = {
+            x1, y1, (int32_t) (x2 - x1 > INT32_MAX ? INT32_MAX : x2 - x1),
+            (int32_t) (y2 - y1 > INT32_MAX ? INT32_MAX : y2 - y1)
+    };
+    return result;
+}
+
+/*
+ * Adds a rectangle while keeping the damage bounded. Rectangles that end up covering each other are folded together,
+ * and once the damage is full the new rectangle is merged with whichever existing rectangle grows the least.
+ */
+static void
+damage_add(struct westfield_damage *damage, struct westfield_damage_rect rect) {
+    uint32_t i = 0;
+
+    if (rect.width <= 0 || rect.height <= 0) {
+        return;
+    }
+
+    while (i < damage->count) {
+        const struct westfield_damage_rect merged = rect_union(&damage->rects[i], &rect);
+        const int64_t merged_area = rect_area(&merged);
+        if (merged_area == rect_area(&damage->rects[i])) {
+            // already covered
+            return;
+        }
+        if (merged_area == rect_area(&rect)) {
+            // covers an existing rectangle, drop it and look again
+            damage->rects[i] = damage->rects[--damage->count];
+            continue;
+        }
+        i++;
+    }
+
+    if (damage->count < WESTFIELD_MAX_DAMAGE_RECTS) {
+        damage->rects[damage->count++] = rect;
+    } else {
+        uint32_t best = 0;
+        int64_t best_growth = INT64_MAX;
+        for (i = 0; i < damage->count; i++) {
+            const struct westfield_damage_rect merged = rect_union(&damage->rects[i], &rect);
+            const int64_t growth = rect_area(&merged) - rect_area(&damage->rects[i]);
+            if (growth < best_growth) {
+                best_growth = growth;
+                best = i;
+            }
+        }
+        rect = rect_union(&damage->rects[best], &rect);
+        damage->rects[best] = damage->rects[--damage->count];
+        // the grown rectangle may now cover others
+        damage_add(damage, rect);
+    }
+}
+
+static void
+surface_commit(struct westfield_surface_tracker *tracker, struct tracked_surface *surface) {
+    // scale and transform stay in effect until they are set again
+    surface->pending.surface_id = surface->id;
+    if (surface->pending.buffer_attached && surface->pending.buffer_id) {
+        buffer_held(tracker, surface->pending.buffer_id);
+    }
+    if (tracker->commit_listener) {
+        tracker->commit_listener(tracker->commit_listener_data, &surface->pending);
+    }
+
+    surface->pending.buffer_attached = false;
+    surface->pending.buffer_id = 0;
+    surface->pending.dx = 0;
+    surface->pending.dy = 0;
+    surface->pending.surface_damage.count = 0;
+    surface->pending.buffer_damage.count = 0;
+}
+
+/*
+ * Returns true if the request only changed pending state that is delivered in the commit record. Damage is only merged
+ * while there is a commit listener to deliver it to, the rest is needed to track buffer holds or stays in effect
+ * across commits.
+ */
+static bool
+surface_pending_request(struct westfield_surface_tracker *tracker, struct tracked_surface *surface,
+                        const uint32_t *wire_message, size_t words, uint32_t opcode) {
+    const int32_t *args = (const int32_t *) &wire_message[2];
+    const size_t arg_count = words - 2;
+
+    switch (opcode) {
+        case WL_SURFACE_ATTACH:
+            if (arg_count < 3) {
+                return false;
+            }
+            surface->pending.buffer_attached = true;
+            surface->pending.buffer_id = wire_message[2];
+            surface->pending.dx = args[1];
+            surface->pending.dy = args[2];
+            if (surface->pending.buffer_id) {
+                struct tracked_object *buffer = track(tracker, surface->pending.buffer_id);
+                if (buffer && buffer->kind == TRACKED_NONE) {
+                    buffer->kind = TRACKED_BUFFER;
+                    buffer->buffer_held = false;
+                    buffer->buffer_hold_serial = 0;
+                    buffer->buffer_js_release_serial = 0;
+                }
+            }
+            return true;
+        case WL_SURFACE_DAMAGE:
+        case WL_SURFACE_DAMAGE_BUFFER:
+            if (tracker->commit_listener == NULL || arg_count < 4) {
+                return false;
+            } else {
+                const struct westfield_damage_rect rect = {args[0], args[1], args[2], args[3]};
+                damage_add(opcode == WL_SURFACE_DAMAGE ? &surface->pending.surface_damage
+                                                       : &surface->pending.buffer_damage, rect);
+            }
+            return true;
+        case WL_SURFACE_SET_BUFFER_TRANSFORM:
+            if (arg_count < 1) {
+                return false;
+            }
+            surface->pending.transform = args[0];
+            return true;
+        case WL_SURFACE_SET_BUFFER_SCALE:
+            if (arg_count < 1) {
+                return false;
+            }
+            surface->pending.scale = args[0];
+            return true;
+        case WL_SURFACE_COMMIT:
+            surface_commit(tracker, surface);
+            return false;
+        default:
+            return false;
+    }
+}
+
+static bool
+surface_request(struct westfield_surface_tracker *tracker, struct tracked_object *surface_object,
+                const uint32_t *wire_message, size_t words, uint32_t opcode) {
+    struct tracked_object *callback;
+
+    switch (opcode) {
+        case WL_SURFACE_DESTROY:
+            destroy_surface(tracker, surface_object);
+            return false;
+        case WL_SURFACE_FRAME:
+            if (words < 3) {
+                return false;
+            }
+            callback = track_new(tracker, wire_message[2]);
+            if (callback) {
+                callback->kind = TRACKED_FRAME_CALLBACK;
+                callback->surface_id = surface_object->surface->id;
+            }
+            return false;
+        default:
+            return words >= 2 && surface_pending_request(tracker, surface_object->surface, wire_message, words, opcode);
+    }
+}
+
+bool
+westfield_surface_tracker_request(struct westfield_surface_tracker *tracker, const uint32_t *wire_message,
+                                  size_t wire_message_size, uint32_t object_id, uint32_t opcode) {
+    struct tracked_object *object = lookup(tracker, object_id);
+    const size_t words = wire_message_size / 4;
+    bool pending_state = false;
+
+    if (object == NULL) {
+        return false;
+    }
+
+    switch (object->kind) {
+        case TRACKED_REGISTRY:
+            registry_request(tracker, wire_message, words, opcode);
+            break;
+        case TRACKED_COMPOSITOR:
+            compositor_request(tracker, wire_message, words, opcode);
+            break;
+        case TRACKED_SURFACE:
+            pending_state = surface_request(tracker, object, wire_message, words, opcode);
+            break;
+        case TRACKED_BUFFER:
+            buffer_request(tracker, object, opcode);
+            break;
+        default:
+            break;
+    }
+
+    return pending_state && tracker->commit_listener != NULL;
+}
+
+/*
+ * A release from JS belongs to the oldest hold it did not release yet. Every hold before the current one that is still
+ * waiting for JS was released natively, as was the current one if it is no longer held. Returns true if the release
+ * belongs to such a hold, the client already got a release for it.
+ */
+static bool
+js_release_dropped(struct westfield_surface_tracker *tracker, struct tracked_object *buffer) {
+    const uint32_t serial = buffer->buffer_js_release_serial + 1;
+
+    if (serial > buffer->buffer_hold_serial) {
+        // not a release of a hold we know of, leave it to JS
+        return false;
+    }
+    buffer->buffer_js_release_serial = serial;
+    if (serial == buffer->buffer_hold_serial && buffer->buffer_held) {
+        buffer_released(tracker, buffer);
+        return false;
+    }
+    return true;
+}
+
+static bool
+should_hold_done(struct westfield_surface_tracker *tracker, struct tracked_object *callback, const uint32_t *message,
+                 size_t size, uint64_t *now) {
+    struct tracked_surface *surface = lookup_surface(tracker, callback->surface_id);
+    uint32_t interval;
+
+    if (surface == NULL) {
+        return false;
+    }
+    interval = frame_interval(tracker, surface);
+    if (interval == 0 && surface->held_events.size == 0) {
+        return false;
+    }
+
+    if (*now == 0) {
+        *now = now_ms();
+    }
+    if (surface->held_events.size == 0 && *now - surface->last_done_ms >= interval) {
+        surface->last_done_ms = *now;
+        return false;
+    }
+
+    if (surface->held_events.size == 0) {
+        schedule_frame_timer(tracker, interval - (*now - surface->last_done_ms));
+    }
+    hold_event(tracker, surface, message, size);
+    callback->held = true;
+    callback->held_at = surface->releases;
+    return true;
+}
+
+void
+westfield_surface_tracker_write_events(struct westfield_surface_tracker *tracker, const uint32_t *messages,
+                                       size_t messages_size) {
+    struct wl_connection *connection = wl_client_get_connection(tracker->client);
+    const uint8_t *const start = (const uint8_t *) messages;
+    const uint8_t *const end = start + messages_size;
+    const uint8_t *run = start, *position = start;
+    uint64_t now = 0;
+
+    while (end - position >= 8) {
+        const uint32_t *message = (const uint32_t *) position;
+        const uint32_t size = message[1] >> 16;
+        const uint32_t opcode = message[1] & 0xffff;
+        struct tracked_object *object;
+        bool held = false;
+
+        if (size < 8 || size > (size_t) (end - position)) {
+            break;
+        }
+
+        object = lookup(tracker, message[0]);
+        if (object && object->kind == TRACKED_FRAME_CALLBACK && opcode == WL_CALLBACK_DONE) {
+            if (run != position) {
+                wl_connection_write(connection, run, (size_t) (position - run));
+                run = position;
+            }
+            held = should_hold_done(tracker, object, message, size, &now);
+        } else if (object && object->kind == TRACKED_BUFFER && opcode == WL_BUFFER_RELEASE) {
+            if (js_release_dropped(tracker, object)) {
+                // already released natively, drop it like a held event that is never written
+                if (run != position) {
+                    wl_connection_write(connection, run, (size_t) (position - run));
+                }
+                held = true;
+            }
+        } else if (message[0] == WL_DISPLAY_ID && opcode == WL_DISPLAY_DELETE_ID && size >= 12 &&
+                   (object = lookup(tracker, message[2])) && object->kind == TRACKED_FRAME_CALLBACK) {
+            // the client may reuse the id as soon as it sees delete_id, so it can not overtake a held done
+            struct tracked_surface *surface = lookup_surface(tracker, object->surface_id);
+            if (object->held && surface && object->held_at == surface->releases) {
+                if (run != position) {
+                    wl_connection_write(connection, run, (size_t) (position - run));
+                }
+                hold_event(tracker, surface, message, size);
+                held = true;
+            }
+            object->kind = TRACKED_NONE;
+        }
+
+        position += size;
+        if (held) {
+            run = position;
+        }
+    }
+
+    // write out what is left, including anything we could not parse
+    if (run != end) {
+        wl_connection_write(connection, run, (size_t) (end - run));
+    }
+}
+
+void
+westfield_surface_tracker_set_commit_listener(struct westfield_surface_tracker *tracker,
+                                              westfield_surface_commit_t commit_listener, void *data) {
+    tracker->commit_listener = commit_listener;
+    tracker->commit_listener_data = data;
+}
+
+int
+westfield_surface_tracker_set_frame_rate_cap(struct westfield_surface_tracker *tracker, uint32_t surface_id,
+                                             uint32_t fps) {
+    const uint32_t interval = fps ? (1000 + fps / 2) / fps : 0;
+
+    if (interval && tracker->frame_timer == NULL) {
+        tracker->frame_timer = wl_event_loop_add_timer(
+                wl_display_get_event_loop(wl_client_get_display(tracker->client)), on_frame_timer, tracker);
+        if (tracker->frame_timer == NULL) {
+            return -1;
+        }
+    }
+
+    if (surface_id == 0) {
+        tracker->frame_interval_ms = interval;
+    } else {
+        struct tracked_surface *surface = lookup_surface(tracker, surface_id);
+        if (surface == NULL) {
+            return -1;
+        }
+        surface->has_frame_interval = true;
+        surface->frame_interval_ms = interval;
+    }
+
+    // held callbacks may be due now
+    if (!wl_list_empty(&tracker->held_surfaces)) {
+        schedule_frame_timer(tracker, 1);
+    }
+    return 0;
+}
+
+int
+westfield_surface_tracker_release_buffer(struct westfield_surface_tracker *tracker, uint32_t buffer_id) {
+    struct tracked_object *buffer = lookup(tracker, buffer_id);
+    struct wl_resource *resource;
+
+    if (buffer == NULL || buffer->kind != TRACKED_BUFFER || !buffer->buffer_held) {
+        return -1;
+    }
+    resource = wl_client_get_object(tracker->client, buffer_id);
+    if (resource == NULL || wl_shm_buffer_get(resource) == NULL) {
+        return -1;
+    }
+
+    wl_buffer_send_release(resource);
+    buffer_released(tracker, buffer);
+    tracker->buffer_stats.native_releases++;
+    return 0;
+}
+
+void
+westfield_surface_tracker_set_auto_release(struct westfield_surface_tracker *tracker, bool auto_release) {
+    tracker->auto_release = auto_release;
+}
+
+void
+westfield_surface_tracker_buffer_consumed(struct westfield_surface_tracker *tracker, uint32_t buffer_id) {
+    if (tracker->auto_release) {
+        westfield_surface_tracker_release_buffer(tracker, buffer_id);
+    }
+}
+
+void
+westfield_surface_tracker_get_buffer_stats(struct westfield_surface_tracker *tracker,
+                                           struct westfield_buffer_stats *stats) {
+    *stats = tracker->buffer_stats;
+}
@@ -0,0 +1,131 @@
+//
+// Native tracking of wl_surface state, parsed straight from the client wire messages.
+//
+
+#ifndef WESTFIELD_SURFACE_TRACKER_H
+#define WESTFIELD_SURFACE_TRACKER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "wayland-server/wayland-server.h"
+
+// damage is merged until it fits in this many rectangles
+#define WESTFIELD_MAX_DAMAGE_RECTS 8
+
+struct westfield_surface_tracker;
+
+struct westfield_damage_rect {
+    int32_t x, y, width, height;
+};
+
+struct westfield_damage {
+    uint32_t count;
+    struct westfield_damage_rect rects[WESTFIELD_MAX_DAMAGE_RECTS];
+};
+
+/*
+ * Everything a wl_surface.commit applied, in one record.
+ */
+struct westfield_surface_commit {
+    uint32_t surface_id;
+    bool buffer_attached;
+    // 0 when a null buffer was attached
+    uint32_t buffer_id;
+    int32_t dx, dy;
+    int32_t scale;
+    int32_t transform;
+    // wl_surface.damage, in surface coordinates
+    struct westfield_damage surface_damage;
+    // wl_surface.damage_buffer, in buffer coordinates
+    struct westfield_damage buffer_damage;
+};
+
+/*
+ * A buffer is held from the commit it was attached in until it is released, either by an event from JS or natively.
+ */
+struct westfield_buffer_stats {
+    // buffers that are held right now, ie. the client's queue depth on the compositor side
+    uint32_t held;
+    uint32_t max_held;
+    uint64_t commits;
+    uint64_t releases;
+    // part of releases that were sent natively
+    uint64_t native_releases;
+    uint64_t total_hold_ms;
+    uint64_t max_hold_ms;
+};
+
+typedef void (*westfield_surface_commit_t)(void *data, const struct westfield_surface_commit *commit);
+
+/*
+ * Needs to see every request of the client from the start, objects are only recognized by the requests that create
+ * them. Until a commit listener or a frame rate cap is set, that and keeping buffer holds is all it does.
+ */
+struct westfield_surface_tracker *
+westfield_surface_tracker_create(struct wl_client *client);
+
+void
+westfield_surface_tracker_destroy(struct westfield_surface_tracker *tracker);
+
+void
+westfield_surface_tracker_registry_created(struct westfield_surface_tracker *tracker, uint32_t registry_id);
+
+/*
+ * Inspects a single client request. Must see every request of the client, in order, before it is handled. Returns true
+ * if a commit listener is set and the request only changed state that the listener receives on commit, in which case
+ * the request needs no further handling.
+ */
+bool
+westfield_surface_tracker_request(struct westfield_surface_tracker *tracker, const uint32_t *wire_message,
+                                  size_t wire_message_size, uint32_t object_id, uint32_t opcode);
+
+/*
+ * Writes events to the client connection. wl_callback.done of frame callbacks of throttled surfaces is held back until
+ * the next allowed tick, together with the matching wl_display.delete_id.
+ */
+void
+westfield_surface_tracker_write_events(struct westfield_surface_tracker *tracker, const uint32_t *messages,
+                                       size_t messages_size);
+
+/*
+ * Starts delivering attach, damage, damage_buffer, set_buffer_scale and set_buffer_transform per surface as a single
+ * record on commit. From then on these requests are absorbed, see westfield_surface_tracker_request. Pass NULL to stop.
+ * Without a listener, damage is not parsed at all, so the first record only holds damage requested after it was set.
+ */
+void
+westfield_surface_tracker_set_commit_listener(struct westfield_surface_tracker *tracker,
+                                              westfield_surface_commit_t commit_listener, void *data);
+
+/*
+ * Caps the rate at which frame callbacks of a surface fire. A surface_id of 0 sets the default for all surfaces of the
+ * client that have no cap of their own. An fps of 0 means uncapped. Returns -1 if the surface is not known.
+ */
+int
+westfield_surface_tracker_set_frame_rate_cap(struct westfield_surface_tracker *tracker, uint32_t surface_id,
+                                             uint32_t fps);
+
+/*
+ * Sends wl_buffer.release for a held shm buffer. The release that JS sends for the same hold later on is dropped, even
+ * if the client committed the buffer again in the mean time. Returns -1 if the buffer is not held or not a shm buffer.
+ */
+int
+westfield_surface_tracker_release_buffer(struct westfield_surface_tracker *tracker, uint32_t buffer_id);
+
+/*
+ * Releases buffers natively as soon as their pixels were consumed, see westfield_surface_tracker_buffer_consumed.
+ */
+void
+westfield_surface_tracker_set_auto_release(struct westfield_surface_tracker *tracker, bool auto_release);
+
+/*
+ * The pixels of a buffer were copied or encoded and the client may reuse it.
+ */
+void
+westfield_surface_tracker_buffer_consumed(struct westfield_surface_tracker *tracker, uint32_t buffer_id);
+
+void
+westfield_surface_tracker_get_buffer_stats(struct westfield_surface_tracker *tracker,
+                                           struct westfield_buffer_stats *stats);
+
+#endif //WESTFIELD_SURFACE_TRACKER_H
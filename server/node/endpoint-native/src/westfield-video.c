@@ -0,0 +1,308 @@
+#include <stdlib.h>
+#include <string.h>
+#include "westfield-compress.h"
+#include "westfield-video.h"
+
+#ifdef WESTFIELD_HAVE_VPX
+#include <vpx/vp8cx.h>
+#include "westfield-yuv.h"
+
+// realtime speed, from 0 (best quality) to 16 (fastest)
+#define VPX_CPU_USED 8
+// the quality level used for a bitrate of 0, from 0 (best) to 63
+#define VPX_BEST_QUALITY_CQ_LEVEL 4
+#define VPX_THREADS 4
+#endif
+
+#define MAX_QUANTIZATION 6
+
+static void
+write_le32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t) value;
+    p[1] = (uint8_t) (value >> 8);
+    p[2] = (uint8_t) (value >> 16);
+    p[3] = (uint8_t) (value >> 24);
+}
+
+struct westfield_video_encoder *
+westfield_video_encoder_create(uint32_t bitrate, uint32_t fps, uint32_t keyframe_interval) {
+    struct westfield_video_encoder *encoder = calloc(1, sizeof(struct westfield_video_encoder));
+    if (encoder == NULL) {
+        return NULL;
+    }
+    encoder->bitrate = bitrate;
+    encoder->fps = fps ? fps : 60;
+    encoder->keyframe_interval = keyframe_interval;
+    return encoder;
+}
+
+void
+westfield_video_encoder_destroy(struct westfield_video_encoder *encoder) {
+#ifdef WESTFIELD_HAVE_VPX
+    if (encoder->vpx_initialized) {
+        vpx_codec_destroy(&encoder->vpx_codec);
+    }
+    free(encoder->i420);
+#endif
+    free(encoder->reference);
+    free(encoder->residual);
+    free(encoder);
+}
+
+static int
+ensure_frame_size(struct westfield_video_encoder *encoder, int32_t width, int32_t height) {
+    const size_t size = (size_t) width * height * sizeof(uint32_t);
+    uint32_t *reference, *residual;
+
+    if (encoder->reference && encoder->width == width && encoder->height == height) {
+        return 0;
+    }
+
+    reference = realloc(encoder->reference, size);
+    if (reference == NULL) {
+        return -1;
+    }
+    encoder->reference = reference;
+    residual = realloc(encoder->residual, size);
+    if (residual == NULL) {
+        return -1;
+    }
+    encoder->residual = residual;
+    encoder->width = width;
+    encoder->height = height;
+    // a new size always starts with a keyframe
+    encoder->frame_count = 0;
+    return 0;
+}
+
+/*
+ * Nudges the quantization so chunks stay around the per frame budget. Keyframes are expected to be larger and only
+ * ever lower the quality.
+ */
+static void
+rate_control(struct westfield_video_encoder *encoder, size_t chunk_size, bool keyframe) {
+    size_t budget;
+
+    if (encoder->bitrate == 0) {
+        encoder->quantization = 0;
+        return;
+    }
+    budget = encoder->bitrate / 8 / encoder->fps;
+    if (keyframe) {
+        budget *= 4;
+    }
+    if (chunk_size > budget + budget / 4 && encoder->quantization < MAX_QUANTIZATION) {
+        encoder->quantization++;
+    } else if (!keyframe && chunk_size < budget / 2 && encoder->quantization > 0) {
+        encoder->quantization--;
+    }
+}
+
+static uint8_t *
+delta_encode(struct westfield_video_encoder *encoder, const uint32_t *pixels, int32_t width, int32_t height,
+             bool force_keyframe, size_t *chunk_size) {
+    const size_t pixel_count = (size_t) width * height;
+    const size_t residual_size = pixel_count * sizeof(uint32_t);
+    // keep alpha exact, only drop color precision
+    const uint32_t channel_mask = (0xffu << encoder->quantization) & 0xffu;
+    const uint32_t mask = 0xff000000u | (channel_mask << 16) | (channel_mask << 8) | channel_mask;
+    // worst case LZ4 expansion
+    const size_t capacity = WESTFIELD_VIDEO_CHUNK_HEADER_SIZE + 4 + residual_size + residual_size / 255 + 16;
+    uint32_t *reference, *residual;
+    uint8_t *chunk;
+    size_t compressed_size;
+    bool keyframe;
+
+    if (ensure_frame_size(encoder, width, height)) {
+        return NULL;
+    }
+    keyframe = force_keyframe || encoder->frame_count == 0 ||
+               (encoder->keyframe_interval && encoder->frame_count % encoder->keyframe_interval == 0);
+
+    reference = encoder->reference;
+    residual = encoder->residual;
+    if (keyframe) {
+        for (size_t i = 0; i < pixel_count; i++) {
+            const uint32_t quantized = pixels[i] & mask;
+            residual[i] = quantized;
+            reference[i] = quantized;
+        }
+    } else {
+        // unchanged pixels turn into runs of zeroes, which is what the block compressor thrives on
+        for (size_t i = 0; i < pixel_count; i++) {
+            const uint32_t quantized = pixels[i] & mask;
+            residual[i] = quantized ^ reference[i];
+            reference[i] = quantized;
+        }
+    }
+
+    chunk = malloc(capacity);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    write_le32(chunk, keyframe ? WESTFIELD_VIDEO_CHUNK_KEYFRAME : 0);
+    write_le32(chunk + 4, (uint32_t) width);
+    write_le32(chunk + 8, (uint32_t) height);
+    write_le32(chunk + 12, encoder->quantization);
+    compressed_size = westfield_compress_block((const uint8_t *) residual, residual_size,
+                                               chunk + WESTFIELD_VIDEO_CHUNK_HEADER_SIZE,
+                                               capacity - WESTFIELD_VIDEO_CHUNK_HEADER_SIZE);
+
+    encoder->frame_count++;
+    *chunk_size = WESTFIELD_VIDEO_CHUNK_HEADER_SIZE + compressed_size;
+    rate_control(encoder, *chunk_size, keyframe);
+    return chunk;
+}
+
+#ifdef WESTFIELD_HAVE_VPX
+
+static void
+vpx_rate_config(struct westfield_video_encoder *encoder) {
+    vpx_codec_enc_cfg_t *config = &encoder->vpx_config;
+
+    if (encoder->bitrate) {
+        config->rc_end_usage = VPX_CBR;
+        config->rc_target_bitrate = encoder->bitrate / 1000 ? encoder->bitrate / 1000 : 1;
+    } else {
+        config->rc_end_usage = VPX_Q;
+    }
+    encoder->vpx_bitrate = encoder->bitrate;
+}
+
+static int
+vpx_init(struct westfield_video_encoder *encoder, int32_t width, int32_t height) {
+    vpx_codec_enc_cfg_t *config = &encoder->vpx_config;
+    struct westfield_i420_layout layout;
+    uint8_t *i420;
+
+    if (encoder->vpx_initialized) {
+        vpx_codec_destroy(&encoder->vpx_codec);
+        encoder->vpx_initialized = false;
+    }
+
+    westfield_i420_layout(width, height, &layout);
+    i420 = realloc(encoder->i420, layout.size);
+    if (i420 == NULL) {
+        return -1;
+    }
+    encoder->i420 = i420;
+    // the planes are set up below, vpx_img_wrap would round the strides of odd sizes up
+    vpx_img_wrap(&encoder->vpx_image, VPX_IMG_FMT_I420, (unsigned int) width, (unsigned int) height, 1, i420);
+    encoder->vpx_image.planes[VPX_PLANE_Y] = i420 + layout.y_offset;
+    encoder->vpx_image.planes[VPX_PLANE_U] = i420 + layout.u_offset;
+    encoder->vpx_image.planes[VPX_PLANE_V] = i420 + layout.v_offset;
+    encoder->vpx_image.stride[VPX_PLANE_Y] = layout.y_stride;
+    encoder->vpx_image.stride[VPX_PLANE_U] = layout.uv_stride;
+    encoder->vpx_image.stride[VPX_PLANE_V] = layout.uv_stride;
+
+    if (vpx_codec_enc_config_default(vpx_codec_vp8_cx(), config, 0) != VPX_CODEC_OK) {
+        return -1;
+    }
+    config->g_w = (unsigned int) width;
+    config->g_h = (unsigned int) height;
+    config->g_timebase.num = 1;
+    config->g_timebase.den = (int) encoder->fps;
+    config->g_threads = VPX_THREADS;
+    // every frame comes out of the encode call that took it in
+    config->g_lag_in_frames = 0;
+    config->g_error_resilient = VPX_ERROR_RESILIENT_DEFAULT;
+    config->rc_dropframe_thresh = 0;
+    config->kf_mode = encoder->keyframe_interval ? VPX_KF_AUTO : VPX_KF_DISABLED;
+    config->kf_min_dist = 0;
+    config->kf_max_dist = encoder->keyframe_interval;
+    vpx_rate_config(encoder);
+
+    if (vpx_codec_enc_init(&encoder->vpx_codec, vpx_codec_vp8_cx(), config, 0) != VPX_CODEC_OK) {
+        return -1;
+    }
+    encoder->vpx_initialized = true;
+    vpx_codec_control(&encoder->vpx_codec, VP8E_SET_CPUUSED, VPX_CPU_USED);
+    vpx_codec_control(&encoder->vpx_codec, VP8E_SET_CQ_LEVEL, VPX_BEST_QUALITY_CQ_LEVEL);
+    encoder->width = width;
+    encoder->height = height;
+    encoder->frame_count = 0;
+    return 0;
+}
+
+static int
+vpx_ensure_codec(struct westfield_video_encoder *encoder, int32_t width, int32_t height) {
+    if (!encoder->vpx_initialized || encoder->width != width || encoder->height != height ||
+        // switching between constant bitrate and constant quality needs a new encoder
+        (encoder->bitrate == 0) != (encoder->vpx_bitrate == 0)) {
+        return vpx_init(encoder, width, height);
+    }
+    if (encoder->bitrate != encoder->vpx_bitrate) {
+        vpx_rate_config(encoder);
+        if (vpx_codec_enc_config_set(&encoder->vpx_codec, &encoder->vpx_config) != VPX_CODEC_OK) {
+            return vpx_init(encoder, width, height);
+        }
+    }
+    return 0;
+}
+
+static uint8_t *
+vpx_encode(struct westfield_video_encoder *encoder, const uint32_t *pixels, int32_t width, int32_t height,
+           bool force_keyframe, size_t *chunk_size) {
+    struct westfield_i420_layout layout;
+    const vpx_codec_cx_pkt_t *packet;
+    vpx_codec_iter_t iter = NULL;
+    uint8_t *chunk = NULL;
+    size_t size = WESTFIELD_VIDEO_CHUNK_HEADER_SIZE;
+    uint32_t flags = WESTFIELD_VIDEO_CHUNK_VP8;
+
+    if (vpx_ensure_codec(encoder, width, height)) {
+        return NULL;
+    }
+    westfield_i420_layout(width, height, &layout);
+    if (westfield_convert_to_i420((const uint8_t *) pixels, width, height, width * 4, false,
+                                  WESTFIELD_YUV_MATRIX_BT601, encoder->i420, &layout, VPX_THREADS)) {
+        return NULL;
+    }
+    if (vpx_codec_encode(&encoder->vpx_codec, &encoder->vpx_image, (vpx_codec_pts_t) encoder->frame_count, 1,
+                         force_keyframe ? VPX_EFLAG_FORCE_KF : 0, VPX_DL_REALTIME) != VPX_CODEC_OK) {
+        return NULL;
+    }
+
+    // without lag there is a single frame packet, but take whatever the encoder hands out
+    while ((packet = vpx_codec_get_cx_data(&encoder->vpx_codec, &iter))) {
+        uint8_t *grown;
+
+        if (packet->kind != VPX_CODEC_CX_FRAME_PKT) {
+            continue;
+        }
+        grown = realloc(chunk, size + packet->data.frame.sz);
+        if (grown == NULL) {
+            free(chunk);
+            return NULL;
+        }
+        chunk = grown;
+        memcpy(chunk + size, packet->data.frame.buf, packet->data.frame.sz);
+        size += packet->data.frame.sz;
+        if (packet->data.frame.flags & VPX_FRAME_IS_KEY) {
+            flags |= WESTFIELD_VIDEO_CHUNK_KEYFRAME;
+        }
+    }
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    write_le32(chunk, flags);
+    write_le32(chunk + 4, (uint32_t) width);
+    write_le32(chunk + 8, (uint32_t) height);
+    write_le32(chunk + 12, 0);
+    encoder->frame_count++;
+    *chunk_size = size;
+    return chunk;
+}
+
+#endif
+
+uint8_t *
+westfield_video_encoder_encode(struct westfield_video_encoder *encoder, const uint32_t *pixels, int32_t width,
+                               int32_t height, bool force_keyframe, size_t *chunk_size) {
+#ifdef WESTFIELD_HAVE_VPX
+    return vpx_encode(encoder, pixels, width, height, force_keyframe, chunk_size);
+#else
+    return delta_encode(encoder, pixels, width, height, force_keyframe, chunk_size);
+#endif
+}
@@ -0,0 +1,68 @@
+//
+// Software video encoding of successive 32 bit frames of a surface. Frames are encoded as VP8 when built with libvpx,
+// which browsers decode with WebCodecs. Otherwise a lossy delta codec is used as a fallback. It quantizes and XORs
+// each frame against the previous one, which suits mostly static content but barely compresses high motion content.
+//
+
+#ifndef WESTFIELD_VIDEO_H
+#define WESTFIELD_VIDEO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef WESTFIELD_HAVE_VPX
+#include <vpx/vpx_encoder.h>
+#endif
+
+#define WESTFIELD_VIDEO_CHUNK_KEYFRAME 1
+#define WESTFIELD_VIDEO_CHUNK_VP8 2
+
+/*
+ * A chunk starts with a header of four little endian uint32 words: flags, width, height and quantization shift.
+ *
+ * With WESTFIELD_VIDEO_CHUNK_VP8 set, it is followed by a VP8 frame. Alpha is dropped and the quantization shift is 0.
+ *
+ * Otherwise it is followed by a compressed residual in the format of westfield_compress_block. A keyframe residual
+ * holds the quantized pixels, a delta residual is XORed over the previous decoded frame.
+ */
+#define WESTFIELD_VIDEO_CHUNK_HEADER_SIZE 16
+
+struct westfield_video_encoder {
+    uint32_t bitrate;
+    uint32_t fps;
+    uint32_t keyframe_interval;
+    int32_t width;
+    int32_t height;
+    // amount of low bits dropped from each color channel, raised and lowered to meet the bitrate
+    uint32_t quantization;
+    uint64_t frame_count;
+    // the frame as the decoder will have reconstructed it
+    uint32_t *reference;
+    uint32_t *residual;
+#ifdef WESTFIELD_HAVE_VPX
+    // initialized for the current size and for the bitrate in vpx_bitrate
+    bool vpx_initialized;
+    uint32_t vpx_bitrate;
+    vpx_codec_ctx_t vpx_codec;
+    vpx_codec_enc_cfg_t vpx_config;
+    vpx_image_t vpx_image;
+    uint8_t *i420;
+#endif
+};
+
+struct westfield_video_encoder *
+westfield_video_encoder_create(uint32_t bitrate, uint32_t fps, uint32_t keyframe_interval);
+
+void
+westfield_video_encoder_destroy(struct westfield_video_encoder *encoder);
+
+/*
+ * Encodes a frame of packed 32 bit pixels, ie. with a stride of width * 4. Returns a malloc'ed chunk or NULL on
+ * allocation failure.
+ */
+uint8_t *
+westfield_video_encoder_encode(struct westfield_video_encoder *encoder, const uint32_t *pixels, int32_t width,
+                               int32_t height, bool force_keyframe, size_t *chunk_size);
+
+#endif //WESTFIELD_VIDEO_H
@@ -2,6 +2,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -11,21 +12,23 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
+#include <spawn.h>
+#include <time.h>
 #include <wayland-private.h>
 #include <wait.h>
 
 #include "string-helpers.h"
+#include "westfield-process.h"
 
-struct westfield_process;
+extern char **environ;
 
-typedef void (*westfield_process_cleanup_func_t)(struct westfield_process *process,
-                                                 int status);
-
-struct westfield_process {
-    pid_t pid;
-    westfield_process_cleanup_func_t cleanup;
-    struct wl_list link;
-};
+// how long to wait before starting a prewarmed xserver, so it doesn't compete with the startup of the compositor
+#define XSERVER_PREWARM_DELAY_MS 500
+// an xserver that exits sooner than this after it was started is considered crashed
+#define XSERVER_MIN_UPTIME_MS 2000
+#define XSERVER_MAX_QUICK_EXITS 3
+// how long an xserver gets to exit on shutdown before it is killed
+#define XSERVER_TERMINATE_TIMEOUT_MS 1000
 
 struct westfield_xserver {
     void *user_data;
@@ -40,10 +43,14 @@ struct westfield_xserver {
     int unix_fd;
     int display;
     pid_t pid;
+    // keep an xserver running before any X client connects
+    bool prewarm;
+    struct wl_event_source *prewarm_source;
+    uint64_t spawned_ms;
+    // exits in a row that came too soon after the start
+    int quick_exits;
 };
 
-static struct wl_list child_process_list;
-
 struct westfield_xwayland {
     struct wl_display *wl_display;
     struct westfield_xserver *xserver;
@@ -51,16 +58,38 @@ struct westfield_xwayland {
     struct westfield_process process;
 };
 
-static struct wl_list child_process_list;
+/* X displays this process holds the lock file of. Several xservers can
+ * run side by side, eg. one for each display. */
+#define MAX_DISPLAYS 256
+static bool display_in_use[MAX_DISPLAYS];
+/* The display DISPLAY was set to, -1 if none. */
+static int display_env = -1;
+/* Where the search for a free display starts, right after the last one
+ * we took. New instances don't have to walk the lock files of all the
+ * others again. */
+static int next_display = 0;
 
 int
 xwayland_get_display(struct westfield_xwayland *westfield_xwayland) {
     return westfield_xwayland->xserver->display;
 }
 
+/* Points DISPLAY at one of the displays that are still in use, or unsets
+ * it if there are none left. */
 static void
-westfield_watch_process(struct westfield_process *process) {
-    wl_list_insert(&child_process_list, &process->link);
+move_display_env(void) {
+    char display_name[8];
+
+    for (int i = 0; i < MAX_DISPLAYS; i++) {
+        if (display_in_use[i]) {
+            snprintf(display_name, sizeof display_name, ":%d", i);
+            setenv("DISPLAY", display_name, 1);
+            display_env = i;
+            return;
+        }
+    }
+    unsetenv("DISPLAY");
+    display_env = -1;
 }
 
 static void
@@ -71,9 +100,20 @@ westfield_xserver_shutdown(struct westfield_xserver *wxs) {
     unlink(path);
     snprintf(path, sizeof path, "/tmp/.X11-unix/X%d", wxs->display);
     unlink(path);
+    display_in_use[wxs->display] = false;
+    if (display_env == wxs->display)
+        move_display_env();
     if (wxs->pid == 0) {
         wl_event_source_remove(wxs->abstract_source);
         wl_event_source_remove(wxs->unix_source);
+    } else {
+        // a prewarmed xserver might not have had any clients to terminate it
+        westfield_process_terminate(&wxs->xwayland->process, XSERVER_TERMINATE_TIMEOUT_MS);
+        wxs->pid = 0;
+    }
+    if (wxs->prewarm_source) {
+        wl_event_source_remove(wxs->prewarm_source);
+        wxs->prewarm_source = NULL;
     }
     close(wxs->abstract_fd);
     close(wxs->unix_fd);
@@ -229,137 +269,236 @@ teardown_xwayland(struct westfield_xwayland *wxw) {
 }
 
 
+/*
+ * The environment of the compositor with WAYLAND_SOCKET set to wayland_socket. Only the array is allocated, free it
+ * with free().
+ */
+static char **
+xserver_environment(char *wayland_socket) {
+    size_t count = 0, i = 0;
+    char **env;
+
+    while (environ[count])
+        count++;
+    env = calloc(count + 2, sizeof(char *));
+    if (env == NULL)
+        return NULL;
+
+    for (size_t j = 0; j < count; j++) {
+        if (strncmp(environ[j], "WAYLAND_SOCKET=", 15) != 0)
+            env[i++] = environ[j];
+    }
+    env[i] = wayland_socket;
+    return env;
+}
+
+static int
+timespec_diff_us(const struct timespec *start, const struct timespec *end) {
+    return (int) ((end->tv_sec - start->tv_sec) * 1000000 + (end->tv_nsec - start->tv_nsec) / 1000);
+}
+
 static pid_t
 spawn_xserver(void *user_data, const char *display, int abstract_fd, int unix_fd) {
     struct westfield_xwayland *wxw = user_data;
     pid_t pid;
-    char s[12], abstract_fd_str[12], unix_fd_str[12], wm_fd_str[12];
-    int sv[2], wm[2], fd;
+    char wayland_socket[32], abstract_fd_str[12], unix_fd_str[12], wm_fd_str[12];
+    char **env;
+    int sv[2], wm[2], ret, child_fd;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t no_signals;
+    struct timespec start, end;
 
     if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
         printf("wl connection socketpair failed\n");
-        return 1;
+        return -1;
     }
 
     if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, wm) < 0) {
         printf("X wm connection socketpair failed\n");
-        return 1;
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
     }
 
-    wxw->wm_fd = wm[0];
     struct wl_client *client = wl_client_create(wxw->wl_display, sv[0]);
-    wxw->xserver->starting_func(wxw->xserver->user_data, wxw->wm_fd, client);
+    if (client == NULL) {
+        printf("failed to create the Xwayland client\n");
+        close(sv[0]);
+        close(sv[1]);
+        close(wm[0]);
+        close(wm[1]);
+        return -1;
+    }
 
-    pid = fork();
-    switch (pid) {
-        case 0:
-//            setenv("WAYLAND_DEBUG", "client", 1);
-//            int output_fd = open("xwayland-out", O_WRONLY | O_CREAT | O_TRUNC, 0600);
-//            dup2(output_fd, STDOUT_FILENO);
-//            dup2(output_fd, STDERR_FILENO);
-            /* SOCK_CLOEXEC closes both ends, so we need to unset
-             * the flag on the client fd. */
-            fd = dup(sv[1]);
-            if (fd < 0) {
-                goto fail;
-            }
-            snprintf(s, sizeof s, "%d", fd);
-            setenv("WAYLAND_SOCKET", s, 1);
-
-            fd = dup(abstract_fd);
-            if (fd < 0) {
-                goto fail;
-            }
-            snprintf(abstract_fd_str, sizeof abstract_fd_str, "%d", fd);
-            fd = dup(unix_fd);
-            if (fd < 0) {
-                goto fail;
-            }
-            snprintf(unix_fd_str, sizeof unix_fd_str, "%d", fd);
-            fd = dup(wm[1]);
-            if (fd < 0) {
-                goto fail;
-            }
-            snprintf(wm_fd_str, sizeof wm_fd_str, "%d", fd);
-
-            signal(SIGUSR1, SIG_IGN);
-            if (execlp("Xwayland",
-                       "Xwayland",
-                       display,
-                       "-rootless",
-                       "-listen", abstract_fd_str,
-                       "-listen", unix_fd_str,
-                       "-wm", wm_fd_str,
-                       "-terminate",
-                       (char *) NULL) < 0)
-                printf("exec of '%s %s -rootless "
-                       "-listen %s -listen %s -wm %s "
-                       "-terminate' failed: %s\n",
-                       "XWayland",
-                       display,
-                       abstract_fd_str,
-                       unix_fd_str,
-                       wm_fd_str,
-                       strerror(errno));
-        fail:
-            _exit(EXIT_FAILURE);
-
-        default:
-            close(sv[1]);
-            close(wm[1]);
-            wxw->process.pid = pid;
-            westfield_watch_process(&wxw->process);
-            break;
-
-        case -1:
-            printf("Failed to fork to spawn xserver process\n");
-            break;
+    /* posix_spawn uses vfork semantics, so unlike fork it doesn't copy the
+     * page tables of our (large) heap. All our fds are SOCK_CLOEXEC. The
+     * ones the xserver should inherit are dup'ed onto new numbers, above all
+     * of them so no dup clobbers another, as a dup doesn't keep the flag. A
+     * dup onto the same number would only clear it since glibc 2.29. */
+    child_fd = sv[1];
+    if (abstract_fd > child_fd)
+        child_fd = abstract_fd;
+    if (unix_fd > child_fd)
+        child_fd = unix_fd;
+    if (wm[1] > child_fd)
+        child_fd = wm[1];
+    child_fd++;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, sv[1], child_fd);
+    snprintf(wayland_socket, sizeof wayland_socket, "WAYLAND_SOCKET=%d", child_fd++);
+    posix_spawn_file_actions_adddup2(&actions, abstract_fd, child_fd);
+    snprintf(abstract_fd_str, sizeof abstract_fd_str, "%d", child_fd++);
+    posix_spawn_file_actions_adddup2(&actions, unix_fd, child_fd);
+    snprintf(unix_fd_str, sizeof unix_fd_str, "%d", child_fd++);
+    posix_spawn_file_actions_adddup2(&actions, wm[1], child_fd);
+    snprintf(wm_fd_str, sizeof wm_fd_str, "%d", child_fd);
+    char *const argv[] = {
+            "Xwayland",
+            (char *) display,
+            "-rootless",
+            "-listen", abstract_fd_str,
+            "-listen", unix_fd_str,
+            "-wm", wm_fd_str,
+            "-terminate",
+            NULL
+    };
+
+    sigemptyset(&no_signals);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &no_signals);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    env = xserver_environment(wayland_socket);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = env ? posix_spawnp(&pid, "Xwayland", &actions, &attr, argv, env) : ENOMEM;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(env);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    close(sv[1]);
+    close(wm[1]);
+    if (ret != 0) {
+        printf("exec of '%s %s -rootless "
+               "-listen %s -listen %s -wm %s "
+               "-terminate' failed: %s\n",
+               "XWayland",
+               display,
+               abstract_fd_str,
+               unix_fd_str,
+               wm_fd_str,
+               strerror(ret));
+        /* also closes sv[0] */
+        wl_client_destroy(client);
+        close(wm[0]);
+        return -1;
     }
 
+    /* Nothing is dispatched before we return, so the xserver can't get
+     * ahead of the compositor setting up its client. */
+    wxw->wm_fd = wm[0];
+    wxw->xserver->starting_func(wxw->xserver->user_data, wxw->wm_fd, client);
+
+    printf("Spawning Xwayland took %d us\n", timespec_diff_us(&start, &end));
+    wxw->process.pid = pid;
+    if (westfield_process_watch(wxw->xserver->loop, &wxw->process) < 0)
+        printf("Failed to watch the xserver process, its exit will go unnoticed\n");
+
     return pid;
 }
 
-static int
-westfield_xserver_handle_event(int listen_fd, uint32_t mask, void *data) {
-    struct westfield_xserver *wxs = data;
+static uint64_t
+now_ms(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+static void
+westfield_xserver_spawn(struct westfield_xserver *wxs) {
     char display[8];
 
     snprintf(display, sizeof display, ":%d", wxs->display);
 
     wxs->pid = spawn_xserver(wxs->xwayland, display, wxs->abstract_fd, wxs->unix_fd);
     if (wxs->pid == -1) {
-        printf("Failed to spawn the Xwayland server\n");
-        return 1;
+        /* The waiting X client would wake us up again right away, and
+         * the next attempt is bound to fail the same way, eg. when
+         * Xwayland is not installed. */
+        printf("Failed to spawn the Xwayland server, shutting down\n");
+        wxs->pid = 0;
+        westfield_xserver_shutdown(wxs);
+        return;
     }
 
     printf("Spawned Xwayland server, pid %d\n", wxs->pid);
+    wxs->spawned_ms = now_ms();
     wl_event_source_remove(wxs->abstract_source);
     wl_event_source_remove(wxs->unix_source);
+}
+
+static int
+westfield_xserver_handle_event(int listen_fd, uint32_t mask, void *data) {
+    struct westfield_xserver *wxs = data;
 
+    westfield_xserver_spawn(wxs);
     return 1;
 }
 
+static int
+westfield_xserver_prewarm(void *data) {
+    struct westfield_xserver *wxs = data;
+
+    // an X client might have beaten us to it
+    if (wxs->pid == 0)
+        westfield_xserver_spawn(wxs);
+    return 0;
+}
+
+/* The first display from display on that isn't in use by us. Lock files
+ * of other processes are checked by create_lockfile. */
+static int
+find_unused_display(int display) {
+    for (int i = 0; i < MAX_DISPLAYS; i++) {
+        int candidate = (display + i) % MAX_DISPLAYS;
+        if (!display_in_use[candidate])
+            return candidate;
+    }
+    return -1;
+}
+
 static int
 westfield_xserver_listen(struct westfield_xserver *wxs) {
     char lockfile[256], display_name[8];
-    wxs->display = 0;
+    int attempts = 0;
+
+    wxs->display = next_display;
     retry:
+    wxs->display = find_unused_display(wxs->display);
+    /* Stale lock files are removed and tried again, so a display can be
+     * attempted twice. */
+    if (wxs->display < 0 || attempts++ == 2 * MAX_DISPLAYS) {
+        printf("no free X display\n");
+        return -1;
+    }
     if (create_lockfile(wxs->display, lockfile, sizeof lockfile) < 0) {
         if (errno == EAGAIN) {
             goto retry;
         } else if (errno == EEXIST) {
-            wxs->display++;
+            wxs->display = (wxs->display + 1) % MAX_DISPLAYS;
             goto retry;
         } else {
-            free(wxs);
             return -1;
         }
     }
 
     wxs->abstract_fd = bind_to_abstract_socket(wxs->display);
     if (wxs->abstract_fd < 0 && errno == EADDRINUSE) {
-        wxs->display++;
         unlink(lockfile);
+        wxs->display = (wxs->display + 1) % MAX_DISPLAYS;
         goto retry;
     }
 
@@ -367,13 +506,20 @@ westfield_xserver_listen(struct westfield_xserver *wxs) {
     if (wxs->unix_fd < 0) {
         unlink(lockfile);
         close(wxs->abstract_fd);
-        free(wxs);
         return -1;
     }
 
+    display_in_use[wxs->display] = true;
+    next_display = (wxs->display + 1) % MAX_DISPLAYS;
+
     snprintf(display_name, sizeof display_name, ":%d", wxs->display);
     printf("xserver listening on display %s\n", display_name);
-    setenv("DISPLAY", display_name, 1);
+    /* DISPLAY can only point to one of them, the others are found through
+     * xwayland_get_display. */
+    if (display_env < 0) {
+        setenv("DISPLAY", display_name, 1);
+        display_env = wxs->display;
+    }
 
     wxs->loop = wl_display_get_event_loop(wxs->wl_display);
     wxs->abstract_source =
@@ -384,6 +530,10 @@ westfield_xserver_listen(struct westfield_xserver *wxs) {
             wl_event_loop_add_fd(wxs->loop, wxs->unix_fd,
                                  WL_EVENT_READABLE,
                                  westfield_xserver_handle_event, wxs);
+    if (wxs->prewarm) {
+        wxs->prewarm_source = wl_event_loop_add_timer(wxs->loop, westfield_xserver_prewarm, wxs);
+        wl_event_source_timer_update(wxs->prewarm_source, XSERVER_PREWARM_DELAY_MS);
+    }
     return 0;
 }
 
@@ -402,20 +552,34 @@ westfield_xserver_exited(struct westfield_xserver *wxs,
                                  WL_EVENT_READABLE,
                                  westfield_xserver_handle_event, wxs);
 
-    // for now this if condition will always be true as we don't clear starting_func.
-    // FIXME when should we clear starting_func ?
-    if (wxs->starting_func) {
-        /* If the X server crashes before it binds to the
-         * xserver interface, shut down and don't try
-         * again. */
-        printf("xserver crashing too fast: %d\n", exit_status);
+    /* A clean exit that comes quickly is fine, eg. -terminate when the X
+     * client that started it was short lived. */
+    if ((!WIFEXITED(exit_status) || WEXITSTATUS(exit_status) != 0) &&
+        now_ms() - wxs->spawned_ms < XSERVER_MIN_UPTIME_MS)
+        wxs->quick_exits++;
+    else
+        wxs->quick_exits = 0;
+
+    if (wxs->quick_exits >= XSERVER_MAX_QUICK_EXITS) {
+        /* If the X server keeps crashing right after it
+         * started, shut down and don't try again. */
+        if (WIFSIGNALED(exit_status))
+            printf("xserver crashing too fast: signal %d\n", WTERMSIG(exit_status));
+        else
+            printf("xserver crashing too fast: code %d\n", WEXITSTATUS(exit_status));
         westfield_xserver_shutdown(wxs);
-    } else {
-        printf("xserver exited, code %d\n", exit_status);
-        if (wxs->destroyed_func)
-            wxs->destroyed_func(wxs->user_data);
-        wxs->destroyed_func = NULL;
+        return;
     }
+
+    /* A normal exit, ie. -terminate after the last X client
+     * disconnected. The next X client starts a new one, unless
+     * we keep one ready. */
+    if (WIFSIGNALED(exit_status))
+        printf("xserver exited, signal %d\n", WTERMSIG(exit_status));
+    else
+        printf("xserver exited, code %d\n", WEXITSTATUS(exit_status));
+    if (wxs->prewarm)
+        wl_event_source_timer_update(wxs->prewarm_source, XSERVER_PREWARM_DELAY_MS);
 }
 
 static void
@@ -430,7 +594,8 @@ struct westfield_xwayland *
 setup_xwayland(struct wl_dislay *wl_display,
                void *user_data,
                westfield_xserver_starting_func_t starting_func,
-               westfield_xserver_destroyed_func_t destroyed_func) {
+               westfield_xserver_destroyed_func_t destroyed_func,
+               bool prewarm) {
     sigset_t mask;
     struct westfield_xserver *westfield_xserver;
     struct westfield_xwayland *westfield_xwayland;
@@ -446,6 +611,10 @@ setup_xwayland(struct wl_dislay *wl_display,
     westfield_xserver->wl_display = (struct wl_display *) wl_display;
     westfield_xserver->starting_func = starting_func;
     westfield_xserver->destroyed_func = destroyed_func;
+    westfield_xserver->prewarm = prewarm;
+    westfield_xserver->prewarm_source = NULL;
+    westfield_xserver->spawned_ms = 0;
+    westfield_xserver->quick_exits = 0;
 
     westfield_xwayland = malloc(sizeof *westfield_xwayland);
     if (!westfield_xwayland) {
@@ -457,6 +626,7 @@ setup_xwayland(struct wl_dislay *wl_display,
     westfield_xwayland->wl_display = (struct wl_display *) wl_display;
     westfield_xwayland->xserver = westfield_xserver;
     westfield_xwayland->process.cleanup = xserver_cleanup;
+    westfield_xwayland->process.source = NULL;
     if (westfield_xserver_listen(westfield_xserver) < 0) {
         free(westfield_xserver);
         free(westfield_xwayland);
@@ -466,7 +636,3 @@ setup_xwayland(struct wl_dislay *wl_display,
     return westfield_xwayland;
 }
 
-void
-init_westfield_xwayland(void) {
-    wl_list_init(&child_process_list);
-}
@@ -27,6 +27,8 @@
 #ifndef WESTFIELD_NATIVE_WESTFIELD_XWAYLAND_H
 #define WESTFIELD_NATIVE_WESTFIELD_XWAYLAND_H
 
+#include <stdbool.h>
+
 struct westfield_xwayland;
 struct westfield_xserver;
 struct wl_dislay;
@@ -39,14 +41,17 @@ typedef void (*westfield_xserver_destroyed_func_t)(void *user_data);
 void
 teardown_xwayland(struct westfield_xwayland *);
 
+/*
+ * Listens on a free X display and starts Xwayland once the first X client connects. With prewarm, Xwayland is started
+ * shortly after setup and again shortly after it exited, so X clients don't have to wait for it. Each call sets up an
+ * independent instance with its own display, wm fd and callbacks, driven from the event loop of wl_display.
+ */
 struct westfield_xwayland *
 setup_xwayland(struct wl_dislay *wl_display,
                void *user_data,
                westfield_xserver_starting_func_t starting_func,
-               westfield_xserver_destroyed_func_t destroyed_func);
-
-void
-init_westfield_xwayland(void);
+               westfield_xserver_destroyed_func_t destroyed_func,
+               bool prewarm);
 
 int
 xwayland_get_display(struct westfield_xwayland *westfield_xwayland);
@@ -0,0 +1,154 @@
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "westfield-parallel.h"
+#include "westfield-yuv.h"
+
+// 8 bit fixed point coefficients for limited range output
+struct yuv_coefficients {
+    int16_t y[3];
+    int16_t u[3];
+    int16_t v[3];
+};
+
+// in r, g, b order
+static const struct yuv_coefficients coefficients[] = {
+        [WESTFIELD_YUV_MATRIX_BT601] = {
+                .y = {66, 129, 25},
+                .u = {-38, -74, 112},
+                .v = {112, -94, -18},
+        },
+        [WESTFIELD_YUV_MATRIX_BT709] = {
+                .y = {47, 157, 16},
+                .u = {-26, -87, 112},
+                .v = {112, -102, -10},
+        },
+};
+
+struct i420_job {
+    const uint8_t *src;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    // byte index of red and blue in a source pixel
+    int red;
+    int blue;
+    const struct yuv_coefficients *coefficients;
+    uint8_t *dst;
+    const struct westfield_i420_layout *layout;
+};
+
+void
+westfield_i420_layout(int32_t width, int32_t height, struct westfield_i420_layout *layout) {
+    const int32_t chroma_width = (width + 1) / 2;
+    const int32_t chroma_height = (height + 1) / 2;
+
+    layout->y_stride = width;
+    layout->uv_stride = chroma_width;
+    layout->y_offset = 0;
+    layout->u_offset = (size_t) width * height;
+    layout->v_offset = layout->u_offset + (size_t) chroma_width * chroma_height;
+    layout->size = layout->v_offset + (size_t) chroma_width * chroma_height;
+}
+
+static void
+convert_luma_row(const struct i420_job *job, const uint8_t *src, uint8_t *dst) {
+    const int16_t *y = job->coefficients->y;
+    int32_t x = 0;
+#ifdef __SSE2__
+    // per pixel byte order, the alpha or padding byte gets a zero coefficient
+    const __m128i coefficient = job->red == 2 ?
+                                _mm_set_epi16(0, y[0], y[1], y[2], 0, y[0], y[1], y[2]) :
+                                _mm_set_epi16(0, y[2], y[1], y[0], 0, y[2], y[1], y[0]);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i offset = _mm_set1_epi32(16);
+
+    for (; x + 4 <= job->width; x += 4) {
+        const __m128i pixels = _mm_loadu_si128((const __m128i *) (src + x * 4));
+        // two sums per pixel: first * c0 + second * c1 and third * c2
+        const __m128i low = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coefficient);
+        const __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coefficient);
+        const __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(low), _mm_castsi128_ps(high),
+                                                             _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(low), _mm_castsi128_ps(high),
+                                                            _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i luma = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(even, odd), round), 8), offset);
+
+        int32_t packed;
+
+        luma = _mm_packs_epi32(luma, luma);
+        luma = _mm_packus_epi16(luma, luma);
+        packed = _mm_cvtsi128_si32(luma);
+        memcpy(dst + x, &packed, sizeof(packed));
+    }
+#endif
+    for (; x < job->width; x++) {
+        const uint8_t *pixel = src + x * 4;
+        dst[x] = (uint8_t) (((y[0] * pixel[job->red] + y[1] * pixel[1] + y[2] * pixel[job->blue] + 128) >> 8) + 16);
+    }
+}
+
+static void
+convert_chroma_row(const struct i420_job *job, const uint8_t *src, const uint8_t *src_next, uint8_t *dst_u,
+                   uint8_t *dst_v) {
+    const int16_t *u = job->coefficients->u;
+    const int16_t *v = job->coefficients->v;
+    const int red = job->red, blue = job->blue;
+
+    for (int32_t x = 0; x < job->width; x += 2) {
+        // average the 2x2 block, or what is left of it at the right and bottom edge
+        const int32_t next_x = x + 1 < job->width ? (x + 1) * 4 : x * 4;
+        const uint8_t *p = src + x * 4, *q = src + next_x, *r = src_next + x * 4, *s = src_next + next_x;
+        const int32_t red_value = (p[red] + q[red] + r[red] + s[red] + 2) >> 2;
+        const int32_t green_value = (p[1] + q[1] + r[1] + s[1] + 2) >> 2;
+        const int32_t blue_value = (p[blue] + q[blue] + r[blue] + s[blue] + 2) >> 2;
+
+        dst_u[x / 2] = (uint8_t) (((u[0] * red_value + u[1] * green_value + u[2] * blue_value + 128) >> 8) + 128);
+        dst_v[x / 2] = (uint8_t) (((v[0] * red_value + v[1] * green_value + v[2] * blue_value + 128) >> 8) + 128);
+    }
+}
+
+// rows are chroma rows, ie. pairs of source rows
+static int
+convert_rows(void *data, int32_t first_row, int32_t last_row) {
+    const struct i420_job *job = data;
+    const struct westfield_i420_layout *layout = job->layout;
+
+    for (int32_t row = first_row; row < last_row; row++) {
+        const int32_t y = row * 2;
+        const uint8_t *src = job->src + (size_t) y * job->stride;
+        const uint8_t *src_next = y + 1 < job->height ? src + job->stride : src;
+
+        convert_luma_row(job, src, job->dst + layout->y_offset + (size_t) y * layout->y_stride);
+        if (y + 1 < job->height) {
+            convert_luma_row(job, src_next, job->dst + layout->y_offset + (size_t) (y + 1) * layout->y_stride);
+        }
+        convert_chroma_row(job, src, src_next,
+                           job->dst + layout->u_offset + (size_t) row * layout->uv_stride,
+                           job->dst + layout->v_offset + (size_t) row * layout->uv_stride);
+    }
+    return 0;
+}
+
+int
+westfield_convert_to_i420(const uint8_t *src, int32_t width, int32_t height, int32_t stride, bool rgbx,
+                          enum westfield_yuv_matrix matrix, uint8_t *dst, const struct westfield_i420_layout *layout,
+                          int max_threads) {
+    const struct i420_job job = {
+            .src = src,
+            .width = width,
+            .height = height,
+            .stride = stride,
+            .red = rgbx ? 0 : 2,
+            .blue = rgbx ? 2 : 0,
+            .coefficients = &coefficients[matrix == WESTFIELD_YUV_MATRIX_BT709 ? WESTFIELD_YUV_MATRIX_BT709 :
+                                          WESTFIELD_YUV_MATRIX_BT601],
+            .dst = dst,
+            .layout = layout,
+    };
+
+    return westfield_parallel_rows((height + 1) / 2, (int64_t) width * height, max_threads, convert_rows,
+                                   (void *) &job);
+}
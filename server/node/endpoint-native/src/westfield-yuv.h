@@ -0,0 +1,43 @@
+//
+// Conversion of 32 bit pixel buffers to planar YUV 4:2:0 (I420).
+//
+
+#ifndef WESTFIELD_YUV_H
+#define WESTFIELD_YUV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum westfield_yuv_matrix {
+    WESTFIELD_YUV_MATRIX_BT601 = 0,
+    WESTFIELD_YUV_MATRIX_BT709 = 1,
+};
+
+struct westfield_i420_layout {
+    size_t y_offset;
+    size_t u_offset;
+    size_t v_offset;
+    int32_t y_stride;
+    int32_t uv_stride;
+    size_t size;
+};
+
+/*
+ * Tightly packed Y, U and V planes, in that order, of a single buffer. Odd sizes round the chroma planes up.
+ */
+void
+westfield_i420_layout(int32_t width, int32_t height, struct westfield_i420_layout *layout);
+
+/*
+ * Converts to limited range I420. Source pixels are B, G, R, X in memory, ie. (A|X)RGB8888 on little endian, or
+ * R, G, B, X if rgbx is set. Row pairs are spread over up to max_threads threads.
+ *
+ * Returns 0 on success.
+ */
+int
+westfield_convert_to_i420(const uint8_t *src, int32_t width, int32_t height, int32_t stride, bool rgbx,
+                          enum westfield_yuv_matrix matrix, uint8_t *dst, const struct westfield_i420_layout *layout,
+                          int max_threads);
+
+#endif //WESTFIELD_YUV_H
@@ -0,0 +1,93 @@
+'use strict'
+
+/**
+ * Maps the content hash of a buffer, see Endpoint.hashShmBuffer, to whatever was used to transfer those contents to the
+ * browser before. Identical commits, across surfaces and clients, can then be send as a reference instead of as
+ * pixels. One cache is meant to be shared by all clients of a display.
+ *
+ * Least recently used entries are evicted once the capacity is reached.
+ */
+class BufferContentCache {
+  /**
+   * @param {number}capacity
+   * @param {function(hash: bigint, value: *):void}[onEvict] To release the browser side resource of an evicted entry.
+   * @return {BufferContentCache}
+   */
+  static create (capacity, onEvict) {
+    return new BufferContentCache(capacity, onEvict)
+  }
+
+  /**
+   * @param {number}capacity
+   * @param {function(hash: bigint, value: *):void}[onEvict]
+   */
+  constructor (capacity, onEvict) {
+    /**
+     * @type {number}
+     */
+    this.capacity = capacity
+    /**
+     * @type {function(hash: bigint, value: *):void|undefined}
+     */
+    this.onEvict = onEvict
+    /**
+     * @type {{hits: number, misses: number, evictions: number}}
+     */
+    this.stats = { hits: 0, misses: 0, evictions: 0 }
+    /**
+     * Insertion order of a Map doubles as recency order.
+     * @type {Map<bigint, *>}
+     * @private
+     */
+    this._entries = new Map()
+  }
+
+  /**
+   * @param {bigint}hash
+   * @return {*|undefined}
+   */
+  get (hash) {
+    const value = this._entries.get(hash)
+    if (value === undefined) {
+      this.stats.misses++
+      return undefined
+    }
+    this.stats.hits++
+    // mark as most recently used
+    this._entries.delete(hash)
+    this._entries.set(hash, value)
+    return value
+  }
+
+  /**
+   * @param {bigint}hash
+   * @param {*}value
+   */
+  set (hash, value) {
+    this._entries.delete(hash)
+    this._entries.set(hash, value)
+    while (this._entries.size > this.capacity) {
+      const [oldestHash, oldestValue] = this._entries.entries().next().value
+      this._entries.delete(oldestHash)
+      this.stats.evictions++
+      if (this.onEvict) {
+        this.onEvict(oldestHash, oldestValue)
+      }
+    }
+  }
+
+  /**
+   * To be called when the browser side resource of an entry is gone.
+   *
+   * @param {bigint}hash
+   */
+  delete (hash) {
+    this._entries.delete(hash)
+  }
+
+  clear () {
+    this._entries.clear()
+  }
+}
+
+module.exports = BufferContentCache
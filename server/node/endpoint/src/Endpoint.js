@@ -187,13 +187,21 @@ class Endpoint {
   }
 
   /**
+   * Xwayland is started when the first X client connects and exits again after the last one disconnected. With
+   * prewarm, an Xwayland is started in the background shortly after setup and after each exit, so X clients don't have
+   * to wait for it. onXWaylandStarting is called for each Xwayland that is started.
+   *
+   * Several instances can run side by side, eg. one per display. Each gets an X display of its own, see
+   * getXWaylandDisplay. DISPLAY is only set for the first one.
+   *
    * @param {Object}wlDisplay
    * @param {function(wmFd:number, wlClient: Object):void}onXWaylandStarting
    * @param {function():void}onXWaylandDestroyed
+   * @param {boolean}[prewarm]
    * @return {Object|undefined}
    */
-  static setupXWayland (wlDisplay, onXWaylandStarting, onXWaylandDestroyed) {
-    return westfieldNative.setupXWayland(wlDisplay, onXWaylandStarting, onXWaylandDestroyed)
+  static setupXWayland (wlDisplay, onXWaylandStarting, onXWaylandDestroyed, prewarm = false) {
+    return westfieldNative.setupXWayland(wlDisplay, onXWaylandStarting, onXWaylandDestroyed, prewarm)
   }
 
   /**
@@ -217,6 +225,177 @@ class Endpoint {
     return westfieldNative.getShmBuffer(wlClient, wlResourceId)
   }
 
+  /**
+   * Counters of the shm pools of all clients. Pools that are large enough to hold frames are prefaulted when they are
+   * mapped, and pools grow in place within a reserved address range unless they outgrow it. Page faults are those taken
+   * while reading shm buffers natively, eg. when hashing or encoding them.
+   *
+   * @return {{poolsCreated: number, bytesPrefaulted: number, resizesInPlace: number, resizesMoved: number, accesses: number, accessPageFaults: number, sigbusFaults: number}}
+   */
+  static getShmStats () {
+    return westfieldNative.getShmStats()
+  }
+
+  /**
+   * Hashes the visible pixels of a shm buffer. Equal hashes mean equal contents, see BufferContentCache.
+   *
+   * @param {Object}wlClient
+   * @param {number}wlResourceId
+   * @return {bigint|null} null if the resource is not a shm buffer, or if the client truncated its pool while it was
+   * being read. The client is sent an error in that case.
+   */
+  static hashShmBuffer (wlClient, wlResourceId) {
+    return westfieldNative.hashShmBuffer(wlClient, wlResourceId)
+  }
+
+  /**
+   * Scales the current contents of a 32 bit shm buffer to the given size with a box filter. Scaling is done on worker
+   * threads directly from the client's memory pool so it never blocks dispatching. The resulting pixels have the same
+   * channel order as the shm buffer.
+   *
+   * @param {Object}wlClient
+   * @param {number}wlResourceId
+   * @param {number}width
+   * @param {number}height
+   * @return {Promise<{pixels: ArrayBuffer, width: number, height: number, format: number}|undefined>} undefined if the
+   * resource is not a 32 bit shm buffer, the size is invalid or the client truncated its pool while it was being read.
+   */
+  static thumbnail (wlClient, wlResourceId, width, height) {
+    return new Promise(resolve => {
+      const queued = westfieldNative.thumbnail(wlClient, wlResourceId, width, height, (pixels, format) => {
+        resolve(pixels ? { pixels, width, height, format } : undefined)
+      })
+      if (!queued) {
+        resolve(undefined)
+      }
+    })
+  }
+
+  /**
+   * Converts the current contents of a 32 bit shm buffer to limited range I420 on worker threads. The Y, U and V planes
+   * are written to a single buffer, the layout matches the one expected by a WebCodecs VideoFrame.
+   *
+   * @param {Object}wlClient
+   * @param {number}wlResourceId
+   * @param {'bt601'|'bt709'}matrix
+   * @param {ArrayBuffer}[target] Written to if it is large enough, eg. one acquired from a FrameBufferPool. It must
+   * not be used until the returned promise resolves.
+   * @return {Promise<{buffer: ArrayBuffer, width: number, height: number, layout: {offset: number, stride: number}[]}|undefined>}
+   * undefined if the resource is not a 32 bit shm buffer or the client truncated its pool while it was being read.
+   */
+  static convertToI420 (wlClient, wlResourceId, matrix, target) {
+    return new Promise(resolve => {
+      const queued = westfieldNative.convertToI420(wlClient, wlResourceId, matrix === 'bt709' ? 1 : 0, target, resolve)
+      if (!queued) {
+        resolve(undefined)
+      }
+    })
+  }
+
+  /**
+   * Creates a detector that keeps the row hashes of the previous frame of a single surface.
+   *
+   * @return {Object}
+   */
+  static createScrollDetector () {
+    return westfieldNative.createScrollDetector()
+  }
+
+  /**
+   * Compares the current contents of a 32 bit shm buffer with the frame that was passed to the detector before. Content
+   * that moved vertically or horizontally is reported as a single copy of a rectangle of the previous frame, which is
+   * found back in the new frame at (x + dx, y + dy). What is left to update after the copy is reported as exposed
+   * rectangles. Without a copy, the exposed rectangles are simply the rows that changed.
+   *
+   * @param {Object}scrollDetector
+   * @param {Object}wlClient
+   * @param {number}wlResourceId
+   * @return {{copy: {x: number, y: number, width: number, height: number, dx: number, dy: number}|undefined, exposed: Int32Array}|null}
+   * exposed holds x, y, width and height of each rectangle. null if the resource is not a 32 bit shm buffer, the client
+   * truncated its pool or the detector is destroyed. A truncated pool leaves the detector at the frame before it.
+   */
+  static detectScroll (scrollDetector, wlClient, wlResourceId) {
+    const record = westfieldNative.detectScroll(scrollDetector, wlClient, wlResourceId)
+    if (record === null) {
+      return null
+    }
+    const values = new Int32Array(record)
+    return {
+      copy: values[0] === 1 ? {
+        x: values[3],
+        y: values[4],
+        width: values[5],
+        height: values[6],
+        dx: values[1],
+        dy: values[2]
+      } : undefined,
+      exposed: values.subarray(8, 8 + values[7] * 4)
+    }
+  }
+
+  /**
+   * Frees the previous frame of the detector. Detectors that are not destroyed are freed once they are garbage
+   * collected.
+   *
+   * @param {Object}scrollDetector
+   */
+  static destroyScrollDetector (scrollDetector) {
+    westfieldNative.destroyScrollDetector(scrollDetector)
+  }
+
+  /**
+   * Creates a software video encoder that keeps state between successive frames of a single surface. Chunks are
+   * decoded with VideoChunkDecoder from westfield-runtime-common.
+   *
+   * When the native module was built with libvpx, chunks carry VP8 frames that can be fed to a WebCodecs VideoDecoder,
+   * see VideoChunkDecoder.parseVp8. Otherwise a lossy delta codec is used as a fallback. It XORs each frame against the
+   * previous one, so it only compresses well when little of the surface changes and should not be used for high motion
+   * content.
+   *
+   * @param {number}bitrate Target bits per second, 0 for best quality.
+   * @param {number}fps Expected frame rate, used to spread the bitrate over frames.
+   * @param {number}keyframeInterval Frames between keyframes, 0 to only emit keyframes on demand.
+   * @return {Object}
+   */
+  static createVideoEncoder (bitrate, fps, keyframeInterval) {
+    return westfieldNative.createVideoEncoder(bitrate, fps, keyframeInterval)
+  }
+
+  /**
+   * Encodes the current contents of a 32 bit shm buffer on a worker thread. Only one frame per encoder can be encoded
+   * at a time.
+   *
+   * @param {Object}videoEncoder
+   * @param {Object}wlClient
+   * @param {number}wlResourceId
+   * @param {boolean}forceKeyframe
+   * @param {function(chunk: ArrayBuffer|undefined, keyframe: boolean):void}onChunk
+   * @return {boolean} false if the encoder is still busy, the resource is not a 32 bit shm buffer or the client truncated
+   * its pool. Nothing is encoded then and the encoder state is left as it was.
+   */
+  static encodeVideoFrame (videoEncoder, wlClient, wlResourceId, forceKeyframe, onChunk) {
+    return westfieldNative.encodeVideoFrame(videoEncoder, wlClient, wlResourceId, forceKeyframe, onChunk)
+  }
+
+  /**
+   * @param {Object}videoEncoder
+   * @param {number}bitrate Target bits per second, 0 for best quality. Takes effect after the frame that is being
+   * encoded, if any.
+   */
+  static setVideoEncoderBitrate (videoEncoder, bitrate) {
+    westfieldNative.setVideoEncoderBitrate(videoEncoder, bitrate)
+  }
+
+  /**
+   * Frees the encoder right away, or once the frame it is encoding completes. That frame is not delivered. Using the
+   * encoder afterwards has no effect.
+   *
+   * @param {Object}videoEncoder
+   */
+  static destroyVideoEncoder (videoEncoder) {
+    westfieldNative.destroyVideoEncoder(videoEncoder)
+  }
+
   /**
    * @param {Object}wlClient
    * @param {function(bufferId:number):void}onBufferCreated
@@ -226,12 +405,48 @@ class Endpoint {
   }
 
   /**
+   * Files are reused, bucketed by size, once the client they were sent to has closed and unmapped them. Bytes past the
+   * contents are zero.
+   *
    * @param {Buffer}contents
+   * @return {number} a file descriptor, -1 on error
    */
   static createMemoryMappedFile (contents) {
     return westfieldNative.createMemoryMappedFile(contents)
   }
 
+  /**
+   * For blobs that are sent to many clients, eg. the keymap. All callers that pass the same contents get a read only fd
+   * of the same sealed file, so a blob is only held in memory once no matter how many clients use it. The file is
+   * exactly as large as the contents and can't be changed by any client.
+   *
+   * @param {Buffer}contents
+   * @return {number} a file descriptor, -1 on error eg. if the kernel does not support sealing.
+   */
+  static createSealedMemoryMappedFile (contents) {
+    return westfieldNative.createSealedMemoryMappedFile(contents)
+  }
+
+  /**
+   * Reuse of the files created by createMemoryMappedFile. Resident bytes is the memory held by the files that are kept
+   * for reuse, whether a client still uses them or not.
+   *
+   * @return {{hits: number, misses: number, files: number, residentBytes: number}}
+   */
+  static getMemoryMappedFileStats () {
+    return westfieldNative.getMemoryMappedFileStats()
+  }
+
+  /**
+   * Sharing of the files created by createSealedMemoryMappedFile. Blobs that no client uses anymore are evicted least
+   * recently used first.
+   *
+   * @return {{hits: number, misses: number, evictions: number, files: number, bytes: number}}
+   */
+  static getSealedMemoryMappedFileStats () {
+    return westfieldNative.getSealedMemoryMappedFileStats()
+  }
+
   /**
    * @param {Object}wlClient
    * @param {Uint32Array}ids array to be filled in
@@ -247,6 +462,92 @@ class Endpoint {
     westfieldNative.makePipe(resultBuffer)
   }
 
+  /**
+   * Tracks wl_surface attach, damage, damage_buffer, set_buffer_scale and set_buffer_transform natively and reports
+   * them as a single record on each commit. Damage is merged into at most 8 rectangles per coordinate space, as
+   * flat x, y, width, height quadruples. While tracking, these requests are no longer passed to the wire message
+   * callback. The commit request itself still is, right after onSurfaceCommit was called for it. Damage is only
+   * parsed while a callback is set, the first record after setting one only holds damage requested since.
+   *
+   * @param {Object}wlClient
+   * @param {?function(commit: {surfaceId: number, bufferAttached: boolean, bufferId: number, dx: number, dy: number, scale: number, transform: number, surfaceDamage: Int32Array, bufferDamage: Int32Array}):void}onSurfaceCommit
+   * null to stop tracking.
+   */
+  static setSurfaceCommitCallback (wlClient, onSurfaceCommit) {
+    westfieldNative.setSurfaceCommitCallback(wlClient, onSurfaceCommit ? (record) => {
+      const header = new Uint32Array(record, 0, 9)
+      const values = new Int32Array(record, 0, 9)
+      const surfaceDamageEnd = 9 + header[7] * 4
+      onSurfaceCommit({
+        surfaceId: header[0],
+        bufferAttached: header[1] === 1,
+        bufferId: header[2],
+        dx: values[3],
+        dy: values[4],
+        scale: values[5],
+        transform: values[6],
+        surfaceDamage: new Int32Array(record, 9 * 4, header[7] * 4),
+        bufferDamage: new Int32Array(record, surfaceDamageEnd * 4, header[8] * 4)
+      })
+    } : null)
+  }
+
+  /**
+   * Caps the rate at which frame callbacks of a surface fire. Frame callback done events are held back natively until
+   * the next allowed tick.
+   *
+   * @param {Object}wlClient
+   * @param {number}surfaceId 0 to set the default for all surfaces of the client that have no cap of their own.
+   * @param {number}fps 0 for uncapped.
+   * @return {boolean} false if the surface is not known.
+   */
+  static setFrameRateCap (wlClient, surfaceId, fps) {
+    return westfieldNative.setFrameRateCap(wlClient, surfaceId, fps)
+  }
+
+  /**
+   * Sends wl_buffer.release for a committed shm buffer right away, without waiting for the browser. The release that
+   * is sent later on for the same commit is dropped, even if the client committed the buffer again in the mean time.
+   * Releases are matched to commits in order, so every commit of the buffer is still expected to be released.
+   *
+   * @param {Object}wlClient
+   * @param {number}bufferId
+   * @return {boolean} false if the buffer is not a shm buffer that is still held.
+   */
+  static releaseBuffer (wlClient, bufferId) {
+    return westfieldNative.releaseBuffer(wlClient, bufferId)
+  }
+
+  /**
+   * Releases shm buffers natively as soon as encodeVideoFrame or convertToI420 has read their pixels, so the client
+   * can reuse them while the frame is still on its way to the browser.
+   *
+   * @param {Object}wlClient
+   * @param {boolean}enabled
+   */
+  static setBufferAutoRelease (wlClient, enabled) {
+    westfieldNative.setBufferAutoRelease(wlClient, enabled)
+  }
+
+  /**
+   * Buffer queue statistics of a client. A buffer is held from the commit it was attached in until it is released.
+   *
+   * @param {Object}wlClient
+   * @return {{held: number, maxHeld: number, commits: number, releases: number, nativeReleases: number, totalHoldMs: number, maxHoldMs: number}}
+   */
+  static getBufferStats (wlClient) {
+    return westfieldNative.getBufferStats(wlClient)
+  }
+
+  /**
+   * @param {Uint8Array}source
+   * @param {Uint8Array}target
+   * @return {number} the size of the compressed batch in target, or 0 if it did not fit.
+   */
+  static compressBatch (source, target) {
+    return westfieldNative.compressBatch(source, target)
+  }
+
   /**
    * @param {object}objectA
    * @param {object}objectB
@@ -0,0 +1,70 @@
+'use strict'
+
+/**
+ * Recycles the array buffers that converted frames are written to, see Endpoint.convertToI420, so a surface that is
+ * streamed does not allocate a new frame sized buffer for every commit. A buffer is released once its contents were
+ * send to the browser.
+ */
+class FrameBufferPool {
+  /**
+   * @param {number}capacity Maximum number of idle buffers that are kept.
+   * @return {FrameBufferPool}
+   */
+  static create (capacity = 4) {
+    return new FrameBufferPool(capacity)
+  }
+
+  /**
+   * @param {number}capacity
+   */
+  constructor (capacity) {
+    /**
+     * @type {number}
+     */
+    this.capacity = capacity
+    /**
+     * @type {{hits: number, misses: number}}
+     */
+    this.stats = { hits: 0, misses: 0 }
+    /**
+     * Most recently released last.
+     * @type {ArrayBuffer[]}
+     * @private
+     */
+    this._idle = []
+  }
+
+  /**
+   * @param {number}minByteLength
+   * @return {ArrayBuffer|undefined} An idle buffer of at least the given size, undefined if there is none.
+   */
+  acquire (minByteLength) {
+    for (let i = this._idle.length - 1; i >= 0; i--) {
+      const buffer = this._idle[i]
+      if (buffer.byteLength >= minByteLength) {
+        this._idle.splice(i, 1)
+        this.stats.hits++
+        return buffer
+      }
+    }
+    this.stats.misses++
+    return undefined
+  }
+
+  /**
+   * @param {ArrayBuffer}buffer
+   */
+  release (buffer) {
+    this._idle.push(buffer)
+    if (this._idle.length > this.capacity) {
+      // the least recently released buffer is the least likely to still have a useful size
+      this._idle.shift()
+    }
+  }
+
+  clear () {
+    this._idle = []
+  }
+}
+
+module.exports = FrameBufferPool
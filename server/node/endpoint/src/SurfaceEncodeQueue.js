@@ -0,0 +1,153 @@
+'use strict'
+
+const { performance } = require('perf_hooks')
+
+/**
+ * Latest-wins encode queue of depth one, one per surface. When a client commits faster than its frames can be encoded,
+ * a frame that did not start encoding yet is replaced by the newer one, and a frame that is already encoding is
+ * cancelled and discarded once it completes. So that a surface that keeps committing faster than it can be encoded
+ * still gets frames out, a frame is delivered regardless after a number of frames in a row were discarded.
+ */
+class SurfaceEncodeQueue {
+  /**
+   * @param {function(frame: *, cancellation: {cancelled: boolean}):Promise<*>|*}encode Encodes a single frame.
+   * Long running encoders should check cancellation.cancelled between stages and bail out early, it is set once the
+   * frame is superseded or the queue is destroyed.
+   * @param {number}[frameBudget] Milliseconds between submit and completion after which a frame counts as late.
+   * @param {number}[maxConsecutiveDiscards] Superseded frames that may be discarded in a row before the frame that is
+   * encoding is delivered anyway.
+   * @return {SurfaceEncodeQueue}
+   */
+  static create (encode, frameBudget = 16, maxConsecutiveDiscards = 2) {
+    return new SurfaceEncodeQueue(encode, frameBudget, maxConsecutiveDiscards)
+  }
+
+  /**
+   * @param {function(frame: *, cancellation: {cancelled: boolean}):Promise<*>|*}encode
+   * @param {number}frameBudget
+   * @param {number}maxConsecutiveDiscards
+   */
+  constructor (encode, frameBudget, maxConsecutiveDiscards) {
+    /**
+     * @type {function(frame: *, cancellation: {cancelled: boolean}):Promise<*>|*}
+     * @private
+     */
+    this._encode = encode
+    /**
+     * @type {number}
+     */
+    this.frameBudget = frameBudget
+    /**
+     * @type {number}
+     */
+    this.maxConsecutiveDiscards = maxConsecutiveDiscards
+    /**
+     * dropped: replaced before encoding started, discarded: superseded or destroyed while encoding, late: delivered
+     * over budget.
+     * @type {{submitted: number, encoded: number, dropped: number, discarded: number, late: number}}
+     */
+    this.stats = { submitted: 0, encoded: 0, dropped: 0, discarded: 0, late: 0 }
+    /**
+     * @type {{frame: *, submitted: number, resolve: function(*):void, reject: function(*):void}|undefined}
+     * @private
+     */
+    this._pending = undefined
+    /**
+     * @type {{cancelled: boolean}|undefined}
+     * @private
+     */
+    this._inFlight = undefined
+    /**
+     * @type {number}
+     * @private
+     */
+    this._consecutiveDiscards = 0
+    /**
+     * @type {boolean}
+     * @private
+     */
+    this._destroyed = false
+  }
+
+  /**
+   * @param {*}frame
+   * @return {Promise<*|undefined>} The encoded frame, or undefined if it was superseded by a newer frame or the queue is
+   * destroyed.
+   */
+  submit (frame) {
+    if (this._destroyed) {
+      return Promise.resolve(undefined)
+    }
+
+    this.stats.submitted++
+    if (this._pending) {
+      this.stats.dropped++
+      this._pending.resolve(undefined)
+    }
+    if (this._inFlight && this._consecutiveDiscards < this.maxConsecutiveDiscards) {
+      this._inFlight.cancelled = true
+    }
+
+    return new Promise((resolve, reject) => {
+      this._pending = { frame, submitted: performance.now(), resolve, reject }
+      if (this._inFlight === undefined) {
+        this._startNext()
+      }
+    })
+  }
+
+  /**
+   * Cancels all outstanding work, eg. when the surface is destroyed.
+   */
+  destroy () {
+    this._destroyed = true
+    if (this._pending) {
+      this._pending.resolve(undefined)
+      this._pending = undefined
+    }
+    if (this._inFlight) {
+      this._inFlight.cancelled = true
+    }
+  }
+
+  /**
+   * @private
+   */
+  _startNext () {
+    const job = this._pending
+    this._pending = undefined
+    const cancellation = { cancelled: false }
+    this._inFlight = cancellation
+
+    Promise.resolve().then(() => this._encode(job.frame, cancellation)).then(result => {
+      if (cancellation.cancelled) {
+        this.stats.discarded++
+        this._consecutiveDiscards++
+        job.resolve(undefined)
+      } else {
+        this.stats.encoded++
+        this._consecutiveDiscards = 0
+        if (performance.now() - job.submitted > this.frameBudget) {
+          this.stats.late++
+        }
+        job.resolve(result)
+      }
+      this._finish()
+    }, error => {
+      job.reject(error)
+      this._finish()
+    })
+  }
+
+  /**
+   * @private
+   */
+  _finish () {
+    this._inFlight = undefined
+    if (this._pending && !this._destroyed) {
+      this._startNext()
+    }
+  }
+}
+
+module.exports = SurfaceEncodeQueue
@@ -0,0 +1,135 @@
+'use strict'
+
+const Endpoint = require('./Endpoint')
+const SurfaceEncodeQueue = require('./SurfaceEncodeQueue')
+
+/**
+ * Feeds the wl_surface commits of a client, see Endpoint.setSurfaceCommitCallback, into a SurfaceEncodeQueue per
+ * surface. Each commit is a frame, so a surface that commits faster than it can be encoded only has its newest commit
+ * encoded.
+ *
+ * The commits of frames that were dropped or discarded are handed over with the next frame that is delivered for the
+ * same surface. Their damage has to be applied together with it, and their buffers still have to be released.
+ */
+class SurfaceFrameEncoder {
+  /**
+   * Starts tracking the surface commits of the client, replacing any commit callback it had.
+   *
+   * @param {Object}wlClient
+   * @param {function(commit: Object, cancellation: {cancelled: boolean}):Promise<*>|*}encode Encodes the surface
+   * contents of a commit. See SurfaceEncodeQueue for cancellation.
+   * @param {function(surfaceId: number, encoded: *, commits: Object[]):void}onFrame commits holds all commits of the
+   * surface since its previous frame, oldest first. The last one is the commit that was encoded.
+   * @param {function(surfaceId: number, error: *):void}[onError] A failed frame is not delivered, its commits are
+   * handed over with the next frame instead. Without onError the rejection is left unhandled.
+   * @param {number}[frameBudget] See SurfaceEncodeQueue.
+   * @return {SurfaceFrameEncoder}
+   */
+  static create (wlClient, encode, onFrame, onError, frameBudget = 16) {
+    const surfaceFrameEncoder = new SurfaceFrameEncoder(wlClient, encode, onFrame, onError, frameBudget)
+    Endpoint.setSurfaceCommitCallback(wlClient, (commit) => surfaceFrameEncoder._onCommit(commit))
+    return surfaceFrameEncoder
+  }
+
+  /**
+   * @param {Object}wlClient
+   * @param {function(commit: Object, cancellation: {cancelled: boolean}):Promise<*>|*}encode
+   * @param {function(surfaceId: number, encoded: *, commits: Object[]):void}onFrame
+   * @param {function(surfaceId: number, error: *):void|undefined}onError
+   * @param {number}frameBudget
+   */
+  constructor (wlClient, encode, onFrame, onError, frameBudget) {
+    /**
+     * @type {Object}
+     */
+    this.wlClient = wlClient
+    /**
+     * @type {function(commit: Object, cancellation: {cancelled: boolean}):Promise<*>|*}
+     * @private
+     */
+    this._encode = encode
+    /**
+     * @type {function(surfaceId: number, encoded: *, commits: Object[]):void}
+     * @private
+     */
+    this._onFrame = onFrame
+    /**
+     * @type {function(surfaceId: number, error: *):void|undefined}
+     * @private
+     */
+    this._onError = onError
+    /**
+     * @type {number}
+     * @private
+     */
+    this._frameBudget = frameBudget
+    /**
+     * @type {Map<number, {queue: SurfaceEncodeQueue, commits: Object[]}>}
+     * @private
+     */
+    this._surfaces = new Map()
+  }
+
+  /**
+   * Summed over all surfaces that are still known, see SurfaceEncodeQueue.
+   * @return {{submitted: number, encoded: number, dropped: number, discarded: number, late: number}}
+   */
+  get stats () {
+    const stats = { submitted: 0, encoded: 0, dropped: 0, discarded: 0, late: 0 }
+    for (const { queue } of this._surfaces.values()) {
+      for (const key in stats) {
+        stats[key] += queue.stats[key]
+      }
+    }
+    return stats
+  }
+
+  /**
+   * Cancels the outstanding frames of a surface, eg. when it is destroyed.
+   *
+   * @param {number}surfaceId
+   */
+  destroySurface (surfaceId) {
+    const surface = this._surfaces.get(surfaceId)
+    if (surface) {
+      surface.queue.destroy()
+      this._surfaces.delete(surfaceId)
+    }
+  }
+
+  /**
+   * Stops tracking the client's commits and cancels the outstanding frames of all its surfaces.
+   */
+  destroy () {
+    Endpoint.setSurfaceCommitCallback(this.wlClient, null)
+    for (const surfaceId of [...this._surfaces.keys()]) {
+      this.destroySurface(surfaceId)
+    }
+  }
+
+  /**
+   * @param {Object}commit
+   * @private
+   */
+  _onCommit (commit) {
+    let surface = this._surfaces.get(commit.surfaceId)
+    if (surface === undefined) {
+      surface = { queue: SurfaceEncodeQueue.create(this._encode, this._frameBudget), commits: [] }
+      this._surfaces.set(commit.surfaceId, surface)
+    }
+    surface.commits.push(commit)
+
+    const frame = surface.queue.submit(commit).then((encoded) => {
+      if (encoded === undefined) {
+        return
+      }
+      const commitCount = surface.commits.indexOf(commit) + 1
+      this._onFrame(commit.surfaceId, encoded, surface.commits.splice(0, commitCount))
+    })
+    if (this._onError) {
+      frame.catch((error) => this._onError(commit.surfaceId, error))
+    }
+  }
+}
+
+module.exports = SurfaceFrameEncoder
@@ -0,0 +1,108 @@
+'use strict'
+
+const Endpoint = require('./Endpoint')
+
+// batches smaller than this are passed through as is
+const DEFAULT_MIN_BATCH_SIZE = 1024
+// weight of the latest sample in the running averages
+const SMOOTHING = 0.125
+// while disabled, every n-th eligible batch is still compressed to see if the data became compressible again
+const PROBE_INTERVAL = 32
+
+/**
+ * Compresses flushed batches of wire messages per connection. Compression switches itself off when the measured ratio
+ * is poor or when it costs more CPU time than it is worth, and periodically probes to switch itself back on.
+ * Compressed batches are decoded with decompressBatch from westfield-runtime-common.
+ */
+class WireCompressor {
+  /**
+   * @return {WireCompressor}
+   */
+  static create () {
+    return new WireCompressor()
+  }
+
+  constructor () {
+    /**
+     * @type {number}
+     */
+    this.minBatchSize = DEFAULT_MIN_BATCH_SIZE
+    /**
+     * Compressed size over original size above which compression is switched off.
+     * @type {number}
+     */
+    this.maxRatio = 0.85
+    /**
+     * Compression time in nanoseconds per input byte above which compression is switched off.
+     * @type {number}
+     */
+    this.maxNanosPerByte = 4
+    /**
+     * @type {boolean}
+     */
+    this.enabled = true
+    /**
+     * @type {{batches: number, compressedBatches: number, bytesIn: number, bytesOut: number}}
+     */
+    this.stats = { batches: 0, compressedBatches: 0, bytesIn: 0, bytesOut: 0 }
+    /**
+     * @type {number}
+     * @private
+     */
+    this._ratio = 0.5
+    /**
+     * @type {number}
+     * @private
+     */
+    this._nanosPerByte = 0
+    /**
+     * @type {number}
+     * @private
+     */
+    this._sinceProbe = 0
+    /**
+     * @type {Uint8Array}
+     * @private
+     */
+    this._target = new Uint8Array(0)
+  }
+
+  /**
+   * @param {Uint8Array}batch
+   * @return {{compressed: boolean, buffer: Uint8Array}}
+   */
+  compress (batch) {
+    this.stats.batches++
+    this.stats.bytesIn += batch.byteLength
+    if (batch.byteLength < this.minBatchSize || (!this.enabled && ++this._sinceProbe < PROBE_INTERVAL)) {
+      this.stats.bytesOut += batch.byteLength
+      return { compressed: false, buffer: batch }
+    }
+    this._sinceProbe = 0
+
+    // anything that does not fit within maxRatio is not worth sending compressed, let the encoder bail out early
+    const capacity = Math.floor(batch.byteLength * this.maxRatio)
+    if (this._target.byteLength < capacity) {
+      this._target = new Uint8Array(capacity)
+    }
+    const start = process.hrtime.bigint()
+    const compressedSize = Endpoint.compressBatch(batch, this._target.subarray(0, capacity))
+    const elapsed = Number(process.hrtime.bigint() - start)
+
+    const ratio = compressedSize === 0 ? 1 : compressedSize / batch.byteLength
+    this._ratio += (ratio - this._ratio) * SMOOTHING
+    this._nanosPerByte += ((elapsed / batch.byteLength) - this._nanosPerByte) * SMOOTHING
+    this.enabled = this._ratio <= this.maxRatio && this._nanosPerByte <= this.maxNanosPerByte
+
+    if (compressedSize === 0) {
+      this.stats.bytesOut += batch.byteLength
+      return { compressed: false, buffer: batch }
+    }
+    this.stats.compressedBatches++
+    this.stats.bytesOut += compressedSize
+    // copy out as the target is reused for the next batch
+    return { compressed: true, buffer: this._target.slice(0, compressedSize) }
+  }
+}
+
+module.exports = WireCompressor
@@ -2,6 +2,73 @@
 
 const Fixed = require('./Fixed')
 
+// Must be a power of 2.
+const STRING_INTERN_CACHE_SIZE = 256
+// Longer strings are unlikely to repeat, don't bother looking them up.
+const STRING_INTERN_MAX_LENGTH = 64
+/**
+ * @type {Array<string|undefined>}
+ */
+const stringInternCache = new Array(STRING_INTERN_CACHE_SIZE).fill(undefined)
+/**
+ * @type {ArrayBuffer|undefined}
+ */
+let stringBytesSource
+/**
+ * @type {Uint8Array}
+ */
+let stringBytes = new Uint8Array(0)
+
+/**
+ * Byte view of the given buffer. The view is reused for as long as strings are read from the same buffer.
+ * @param {ArrayBuffer}buffer
+ * @return {Uint8Array}
+ */
+function bytesOf (buffer) {
+  if (stringBytesSource !== buffer) {
+    stringBytesSource = buffer
+    stringBytes = new Uint8Array(buffer)
+  }
+  return stringBytes
+}
+
+/**
+ * Short strings are looked up in a small cache using an FNV-1a hash of their content, so strings that keep repeating
+ * (interface names, mime types, app ids, cursor names...) are decoded without allocation.
+ *
+ * @param {ArrayBuffer}buffer
+ * @param {number}byteOffset
+ * @param {number}length
+ * @return {string}
+ */
+function decodeString (buffer, byteOffset, length) {
+  const bytes = bytesOf(buffer)
+  if (length > STRING_INTERN_MAX_LENGTH) {
+    return String.fromCharCode.apply(null, bytes.subarray(byteOffset, byteOffset + length))
+  }
+
+  let hash = 0x811c9dc5
+  for (let i = byteOffset; i < byteOffset + length; i++) {
+    hash = Math.imul(hash ^ bytes[i], 0x01000193)
+  }
+
+  const slot = hash & (STRING_INTERN_CACHE_SIZE - 1)
+  const cached = stringInternCache[slot]
+  if (cached !== undefined && cached.length === length) {
+    let i = 0
+    while (i < length && cached.charCodeAt(i) === bytes[byteOffset + i]) {
+      i++
+    }
+    if (i === length) {
+      return cached
+    }
+  }
+
+  const value = String.fromCharCode.apply(null, bytes.subarray(byteOffset, byteOffset + length))
+  stringInternCache[slot] = value
+  return value
+}
+
 class WireMessageUtil {
   /**
    * @param {{buffer: ArrayBuffer, fds: Array, bufferOffset: number, consumed: number, size: number}} wireMsg
@@ -105,9 +172,10 @@ class WireMessageUtil {
     } else {
       const alignedSize = ((stringSize + 3) & ~3)
       this._checkMessageSize(wireMsg, alignedSize)
-      const byteArray = new Uint8Array(wireMsg.buffer, wireMsg.bufferOffset, stringSize - 1)
+      // size -1 to eliminate null byte
+      const arg = decodeString(wireMsg.buffer, wireMsg.bufferOffset, stringSize - 1)
       wireMsg.bufferOffset += alignedSize
-      return String.fromCharCode.apply(null, byteArray)
+      return arg
     }
   }
 
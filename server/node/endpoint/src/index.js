@@ -29,5 +29,10 @@ module.exports = {
   FdUtils: require('./FdUtils'),
   WireMessageUtil: require('./WireMessageUtil'),
   nativeGlobalNames: require('./NativeGlobalNames'),
-  MessageInterceptor: require('./MessageInterceptor')
+  MessageInterceptor: require('./MessageInterceptor'),
+  WireCompressor: require('./WireCompressor'),
+  BufferContentCache: require('./BufferContentCache'),
+  SurfaceEncodeQueue: require('./SurfaceEncodeQueue'),
+  SurfaceFrameEncoder: require('./SurfaceFrameEncoder'),
+  FrameBufferPool: require('./FrameBufferPool')
 }
\ No newline at end of file
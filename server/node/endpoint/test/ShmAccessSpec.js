@@ -0,0 +1,185 @@
+const assert = require('assert')
+const childProcess = require('child_process')
+const path = require('path')
+const readline = require('readline')
+
+const {Epoll} = require('epoll')
+
+const Endpoint = require('../src/Endpoint')
+
+const width = 1024
+const height = 1024
+const poolCount = 4
+
+function startClient (wlDisplayName) {
+  const childEnv = {}
+  Object.assign(childEnv, process.env)
+  childEnv.WAYLAND_DISPLAY = wlDisplayName
+
+  const child = childProcess.spawn('python3', [path.join(__dirname, 'fixtures', 'shm-client.py'), width, height, poolCount],
+    {env: childEnv, stdio: ['pipe', 'pipe', 'inherit']})
+  const lines = readline.createInterface({input: child.stdout})
+  const replies = []
+  let onReady
+  const ready = new Promise((resolve) => { onReady = resolve })
+  lines.on('line', (line) => {
+    if (line.startsWith('ready')) {
+      onReady(line.split(' ').slice(1).map(Number))
+    } else {
+      replies.shift()()
+    }
+  })
+
+  return {
+    ready,
+    command: (command) => new Promise((resolve) => {
+      replies.push(resolve)
+      child.stdin.write(command + '\n')
+    }),
+    kill: () => child.kill()
+  }
+}
+
+function assertRowPattern (pixels, seed) {
+  const bytes = new Uint8Array(pixels)
+  for (let y = 0; y < height; y++) {
+    for (let x = 0; x < width * 4; x++) {
+      if (bytes[y * width * 4 + x] !== ((x * 7 + seed) & 0xff)) {
+        assert.fail(`unexpected pixel byte at ${x},${y}`)
+      }
+    }
+  }
+}
+
+describe('Shm access', () => {
+  let wlClient
+  let wlDisplay
+  let wlDisplayFd
+  let fdWatcher
+  let client
+
+  beforeEach(() => {
+    wlClient = undefined
+    wlDisplay = Endpoint.createDisplay((newClient) => {
+      wlClient = newClient
+      Endpoint.setClientDestroyedCallback(newClient, () => {})
+      Endpoint.setWireMessageCallback(newClient, () => 1)
+      Endpoint.setWireMessageEndCallback(newClient, () => {})
+      Endpoint.setRegistryCreatedCallback(newClient, (registry) => Endpoint.emitGlobals(registry))
+    }, () => {}, () => {})
+    Endpoint.initShm(wlDisplay)
+    const wlDisplayName = Endpoint.addSocketAuto(wlDisplay)
+    wlDisplayFd = Endpoint.getFd(wlDisplay)
+    fdWatcher = new Epoll((err) => {
+      assert(err == null)
+      Endpoint.dispatchRequests(wlDisplay)
+      if (wlClient) {
+        Endpoint.flush(wlClient)
+      }
+    })
+    fdWatcher.add(wlDisplayFd, Epoll.EPOLLPRI | Epoll.EPOLLIN | Epoll.EPOLLERR)
+    client = startClient(wlDisplayName)
+  })
+
+  afterEach(() => {
+    client.kill()
+    fdWatcher.remove(wlDisplayFd)
+    fdWatcher.close()
+    Endpoint.destroyDisplay(wlDisplay)
+  })
+
+  async function filledBufferIds () {
+    const bufferIds = await client.ready
+    // give the endpoint a moment to dispatch the buffer creation
+    await new Promise((resolve) => setTimeout(resolve, 100))
+    for (let pool = 0; pool < poolCount; pool++) {
+      await client.command(`fill ${pool} ${pool}`)
+    }
+    return bufferIds
+  }
+
+  it('should read intact pools from concurrent worker threads while other pools are truncated', async () => {
+    // given
+    const bufferIds = await filledBufferIds()
+
+    // when
+    // every pool is read at full size, which scales on several threads per read, while the odd pools are truncated
+    const truncatedPools = []
+    for (let round = 0; round < 8; round++) {
+      const reads = bufferIds.map((bufferId) => Endpoint.thumbnail(wlClient, bufferId, width, height))
+      const truncations = []
+      if (round === 3) {
+        for (let pool = 1; pool < poolCount; pool += 2) {
+          truncations.push(client.command(`truncate ${pool}`).then(() => truncatedPools.push(pool)))
+        }
+      }
+      const thumbnails = await Promise.all(reads)
+      await Promise.all(truncations)
+
+      // then
+      // intact pools are always read as they are, a read of a truncated pool either completed before the truncation
+      // or is reported as failed
+      thumbnails.forEach((thumbnail, pool) => {
+        if (!truncatedPools.includes(pool)) {
+          assert(thumbnail, `pool ${pool} was not read in round ${round}`)
+          assertRowPattern(thumbnail.pixels, pool)
+        } else if (round > 3) {
+          assert.strictEqual(thumbnail, undefined)
+        } else if (thumbnail) {
+          assertRowPattern(thumbnail.pixels, pool)
+        }
+      })
+    }
+    assert.deepStrictEqual(truncatedPools.sort(), [1, 3])
+  })
+
+  it('should not hash a truncated pool', async () => {
+    // given
+    const bufferIds = await filledBufferIds()
+    const intactHash = Endpoint.hashShmBuffer(wlClient, bufferIds[0])
+    await client.command('truncate 1')
+
+    // when
+    const truncatedHash = Endpoint.hashShmBuffer(wlClient, bufferIds[1])
+
+    // then
+    assert.strictEqual(typeof intactHash, 'bigint')
+    assert.strictEqual(truncatedHash, null)
+  })
+
+  it('should not compare the next frame with a truncated pool when detecting scrolls', async () => {
+    // given
+    const bufferIds = await filledBufferIds()
+    const scrollDetector = Endpoint.createScrollDetector()
+    Endpoint.detectScroll(scrollDetector, wlClient, bufferIds[0])
+    await client.command('truncate 1')
+
+    // when
+    const truncatedScroll = Endpoint.detectScroll(scrollDetector, wlClient, bufferIds[1])
+    const nextScroll = Endpoint.detectScroll(scrollDetector, wlClient, bufferIds[0])
+
+    // then
+    assert.strictEqual(truncatedScroll, null)
+    assert.strictEqual(nextScroll.copy, undefined)
+    assert.strictEqual(nextScroll.exposed.length, 0)
+    Endpoint.destroyScrollDetector(scrollDetector)
+  })
+
+  it('should not encode a video frame of a truncated pool', async () => {
+    // given
+    const bufferIds = await filledBufferIds()
+    const videoEncoder = Endpoint.createVideoEncoder(0, 60, 0)
+    await client.command('truncate 1')
+
+    // when
+    const truncatedEncode = Endpoint.encodeVideoFrame(videoEncoder, wlClient, bufferIds[1], false, () => {})
+    const chunk = await new Promise((resolve) => {
+      assert(Endpoint.encodeVideoFrame(videoEncoder, wlClient, bufferIds[0], false, resolve))
+    })
+
+    // then
+    assert.strictEqual(truncatedEncode, false)
+    assert(chunk instanceof ArrayBuffer)
+    Endpoint.destroyVideoEncoder(videoEncoder)
+  })
+})
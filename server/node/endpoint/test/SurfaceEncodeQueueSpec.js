@@ -0,0 +1,89 @@
+const assert = require('assert')
+
+const SurfaceEncodeQueue = require('../src/SurfaceEncodeQueue')
+
+function delay (ms) {
+  return new Promise((resolve) => setTimeout(resolve, ms))
+}
+
+describe('Surface encode queue', () => {
+  it('should discard a frame that is superseded while it is encoding', async () => {
+    // given
+    const cancellations = []
+    const queue = SurfaceEncodeQueue.create(async (frame, cancellation) => {
+      cancellations.push(cancellation)
+      await delay(10)
+      return frame
+    })
+    const superseded = queue.submit(0)
+    await delay(0)
+
+    // when
+    const latest = queue.submit(1)
+
+    // then
+    assert.strictEqual(cancellations[0].cancelled, true)
+    assert.strictEqual(await superseded, undefined)
+    assert.strictEqual(await latest, 1)
+    assert.strictEqual(cancellations[1].cancelled, false)
+    assert.strictEqual(queue.stats.discarded, 1)
+    assert.strictEqual(queue.stats.encoded, 1)
+  })
+
+  it('should keep delivering frames while frames are submitted faster than they are encoded', async () => {
+    // given
+    const encoded = []
+    const queue = SurfaceEncodeQueue.create(async (frame) => {
+      await delay(10)
+      encoded.push(frame)
+      return frame
+    }, 16, 2)
+
+    // when
+    const results = []
+    for (let frame = 0; frame < 60; frame++) {
+      results.push(queue.submit(frame))
+      await delay(2)
+    }
+    const delivered = (await Promise.all(results)).filter((result) => result !== undefined)
+
+    // then
+    // every third frame that starts encoding is delivered even though a newer one is waiting, and so is the newest
+    assert(delivered.length > 3, `only ${delivered.length} frames delivered`)
+    assert.deepStrictEqual(delivered, [...delivered].sort((a, b) => a - b))
+    assert.strictEqual(delivered[delivered.length - 1], 59)
+    assert.strictEqual(queue.stats.submitted, 60)
+    assert.strictEqual(queue.stats.encoded, delivered.length)
+    assert.strictEqual(queue.stats.discarded, encoded.length - delivered.length)
+    assert(queue.stats.discarded <= 2 * delivered.length)
+    assert.strictEqual(queue.stats.dropped, 60 - encoded.length)
+  })
+
+  it('should cancel outstanding work and not encode anything once destroyed', async () => {
+    // given
+    const encoded = []
+    let inFlightCancellation
+    const queue = SurfaceEncodeQueue.create(async (frame, cancellation) => {
+      inFlightCancellation = cancellation
+      await delay(10)
+      encoded.push(frame)
+      return frame
+    })
+    const inFlight = queue.submit(0)
+    const pending = queue.submit(1)
+    await delay(0)
+
+    // when
+    queue.destroy()
+    const afterDestroy = queue.submit(2)
+
+    // then
+    assert.strictEqual(inFlightCancellation.cancelled, true)
+    assert.strictEqual(await inFlight, undefined)
+    assert.strictEqual(await pending, undefined)
+    assert.strictEqual(await afterDestroy, undefined)
+    await delay(20)
+    assert.deepStrictEqual(encoded, [0])
+    assert.strictEqual(queue.stats.discarded, 1)
+  })
+})
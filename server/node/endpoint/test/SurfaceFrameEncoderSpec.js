@@ -0,0 +1,56 @@
+const assert = require('assert')
+
+const Endpoint = require('../src/Endpoint')
+const SurfaceFrameEncoder = require('../src/SurfaceFrameEncoder')
+
+function delay (ms) {
+  return new Promise((resolve) => setTimeout(resolve, ms))
+}
+
+describe('Surface frame encoder', () => {
+  const setSurfaceCommitCallback = Endpoint.setSurfaceCommitCallback
+  let onSurfaceCommit
+
+  beforeEach(() => {
+    onSurfaceCommit = undefined
+    Endpoint.setSurfaceCommitCallback = (wlClient, callback) => { onSurfaceCommit = callback }
+  })
+
+  afterEach(() => {
+    Endpoint.setSurfaceCommitCallback = setSurfaceCommitCallback
+  })
+
+  it('should hand over the commits of skipped frames with the next frame of the surface', async () => {
+    // given
+    const frames = []
+    const surfaceFrameEncoder = SurfaceFrameEncoder.create({}, async (commit) => {
+      await delay(10)
+      return `frame ${commit.bufferId}`
+    }, (surfaceId, encoded, commits) => {
+      frames.push({ surfaceId, encoded, bufferIds: commits.map((commit) => commit.bufferId) })
+    })
+
+    // when
+    for (let bufferId = 1; bufferId <= 6; bufferId++) {
+      onSurfaceCommit({ surfaceId: 3, bufferId })
+      onSurfaceCommit({ surfaceId: 4, bufferId: bufferId + 100 })
+      await delay(2)
+    }
+    await delay(50)
+
+    // then
+    for (const surfaceId of [3, 4]) {
+      const surfaceFrames = frames.filter((frame) => frame.surfaceId === surfaceId)
+      const lastBufferId = surfaceId === 3 ? 6 : 106
+      assert(surfaceFrames.length < 6, 'no frame was skipped')
+      assert.strictEqual(surfaceFrames[surfaceFrames.length - 1].encoded, `frame ${lastBufferId}`)
+      // every commit is handed over once, in order
+      assert.deepStrictEqual(surfaceFrames.flatMap((frame) => frame.bufferIds),
+        [1, 2, 3, 4, 5, 6].map((bufferId) => surfaceId === 3 ? bufferId : bufferId + 100))
+    }
+    assert.strictEqual(surfaceFrameEncoder.stats.submitted, 12)
+
+    surfaceFrameEncoder.destroy()
+    assert.strictEqual(onSurfaceCommit, null)
+  })
+})
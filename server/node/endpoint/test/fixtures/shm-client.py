@@ -0,0 +1,80 @@
+# Minimal wayland client that creates one shm pool with a single ARGB8888 buffer per pool, and then lets the test drive
+# the pool contents over stdin:
+#   fill <pool> <seed>  fills each row with the bytes (x * 7 + seed) & 0xff
+#   truncate <pool>     truncates the pool's file to 0 bytes, without telling the compositor
+#   quit
+# Prints 'ready <buffer id>...' once the buffers are created and 'ok' after each command.
+import mmap, os, socket, struct, sys
+
+W, H, POOLS = int(sys.argv[1]), int(sys.argv[2]), int(sys.argv[3])
+STRIDE = W * 4
+sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+sock.connect(os.path.join(os.environ['XDG_RUNTIME_DIR'], os.environ['WAYLAND_DISPLAY']))
+
+
+def send(obj, opcode, payload=b'', fds=()):
+    msg = struct.pack('<II', obj, ((8 + len(payload)) << 16) | opcode) + payload
+    if fds:
+        sock.sendmsg([msg], [(socket.SOL_SOCKET, socket.SCM_RIGHTS, struct.pack('<%di' % len(fds), *fds))])
+    else:
+        sock.sendall(msg)
+
+
+def wl_string(s):
+    b = s.encode() + b'\0'
+    return struct.pack('<I', len(b)) + b + b'\0' * ((4 - len(b) % 4) % 4)
+
+
+def roundtrip(callback_id):
+    global received
+    send(1, 0, struct.pack('<I', callback_id))
+    while True:
+        while len(received) >= 8:
+            obj, header = struct.unpack_from('<II', received)
+            size = header >> 16
+            if len(received) < size:
+                break
+            message = received[:size]
+            received = received[size:]
+            yield obj, header & 0xffff, message
+            if obj == callback_id:
+                return
+        received += sock.recv(65536)
+
+
+received = b''
+shm_name = None
+send(1, 1, struct.pack('<I', 2))  # wl_display.get_registry -> 2
+for obj, opcode, message in roundtrip(3):
+    if obj == 2 and opcode == 0:
+        name, length = struct.unpack_from('<II', message, 8)
+        if message[16:16 + length - 1].decode() == 'wl_shm':
+            shm_name = name
+
+send(2, 0, struct.pack('<I', shm_name) + wl_string('wl_shm') + struct.pack('<II', 1, 4))  # bind -> 4
+pools = []
+buffer_ids = []
+next_id = 5
+for i in range(POOLS):
+    fd = os.memfd_create('shm-client-pool')
+    os.ftruncate(fd, STRIDE * H)
+    pools.append((fd, mmap.mmap(fd, STRIDE * H)))
+    send(4, 0, struct.pack('<Ii', next_id, STRIDE * H), fds=[fd])  # create_pool
+    send(next_id, 0, struct.pack('<IiiiiI', next_id + 1, 0, W, H, STRIDE, 0))  # create_buffer
+    buffer_ids.append(next_id + 1)
+    next_id += 2
+for _ in roundtrip(next_id):
+    pass
+
+print('ready ' + ' '.join(map(str, buffer_ids)), flush=True)
+for line in sys.stdin:
+    command = line.split()
+    if command[0] == 'fill':
+        pool, seed = int(command[1]), int(command[2])
+        row = bytes(((x * 7 + seed) & 0xff) for x in range(STRIDE))
+        pools[pool][1][:] = row * H
+    elif command[0] == 'truncate':
+        os.ftruncate(pools[int(command[1])][0], 0)
+    elif command[0] == 'quit':
+        break
+    print('ok', flush=True)
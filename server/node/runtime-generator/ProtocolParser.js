@@ -33,6 +33,14 @@ const upperCamelCase = require('uppercamelcase')
 
 const ProtocolArguments = require('./ProtocolArguments')
 
+/**
+ * Events that may be superseded by a newer event of the same type while the client connection is congested.
+ * @type {Object.<string, Array<string>>}
+ */
+const obsoletableEvents = {
+  wl_pointer: ['motion', 'frame']
+}
+
 class ProtocolParser {
   static _generateEventArgs (out, req) {
     if (req.hasOwnProperty('arg')) {
@@ -70,7 +78,9 @@ class ProtocolParser {
         const argInterface = arg.$.hasOwnProperty('interface') ? `${upperCamelCase(arg.$.interface)}Resource` : undefined
         const argType = arg.$.type
 
-        out.write(`, ${argName}: ${ProtocolArguments[argType](argName, optional, argInterface).jsType}`)
+        // received arrays are unmarshalled as plain array buffers
+        const jsType = argType === 'array' ? (optional ? 'ArrayBuffer|undefined' : 'ArrayBuffer') : ProtocolArguments[argType](argName, optional, argInterface).jsType
+        out.write(`, ${argName}: ${jsType}`)
       }
     }
   }
@@ -149,7 +159,7 @@ class ProtocolParser {
     requestsOut.write('): void\n')
   }
 
-  _parseItfEvent (out, itfEvent, opcode) {
+  _parseItfEvent (out, itfName, itfEvent, opcode) {
     const sinceVersion = itfEvent.$.hasOwnProperty('since') ? parseInt(itfEvent.$.since) : 1
 
     const reqName = camelCase(itfEvent.$.name)
@@ -197,7 +207,7 @@ class ProtocolParser {
     ProtocolParser._generateEventArgs(out, itfEvent)
     out.write(') {\n')
 
-    let itfName
+    let newItfName
     // function args
     let argArray = '['
     if (itfEvent.hasOwnProperty('arg')) {
@@ -210,7 +220,7 @@ class ProtocolParser {
         const optional = arg.$.hasOwnProperty('allow-null') && (arg.$['allow-null'] === 'true')
 
         if (argType === 'new_id') {
-          itfName = upperCamelCase(arg.$['interface'])
+          newItfName = upperCamelCase(arg.$['interface'])
         }
 
         if (i !== 0) {
@@ -222,8 +232,10 @@ class ProtocolParser {
     }
     argArray += ']'
 
-    if (itfName) {
+    if (newItfName) {
       out.write(`\t\treturn this.client.marshallConstructor(this.id, ${opcode}, ${argArray})\n`)
+    } else if ((obsoletableEvents[itfName] || []).includes(itfEvent.$.name)) {
+      out.write(`\t\tthis.client.marshall(this.id, ${opcode}, ${argArray}, true)\n`)
     } else {
       out.write(`\t\tthis.client.marshall(this.id, ${opcode}, ${argArray})\n`)
     }
@@ -285,7 +297,7 @@ class ProtocolParser {
     if (protocolItf.hasOwnProperty('event')) {
       const itfEvents = protocolItf.event
       for (let j = 0; j < itfEvents.length; j++) {
-        this._parseItfEvent(out, itfEvents[j], j)
+        this._parseItfEvent(out, itfNameOrig, itfEvents[j], j)
       }
     }
 
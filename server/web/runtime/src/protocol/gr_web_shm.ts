@@ -59,6 +59,9 @@ export class GrWebShmBufferResource extends Westfield.Resource {
 	async [0] (message: WlMessage) {
 		await this.implementation.attach(this, h(message))
 	}
+	async [1] (message: WlMessage) {
+		await this.implementation.attachDamaged(this, h(message), a(message))
+	}
 }
 
 export interface GrWebShmBufferRequests {
@@ -80,6 +83,30 @@ export interface GrWebShmBufferRequests {
 	 *
 	 */
 	attach(resource: GrWebShmBufferResource, contents: WebFD): void
+
+	/**
+	 *
+	 *                Attaches an HTML5 array buffer holding only the pixels of the given damaged rectangles. The compositor
+	 *                copies these rectangles into the contents it retained from the previous attach or attach_damaged, so
+	 *                everything outside the rectangles is left unchanged. This request is only valid after at least one
+	 *                attach request.
+	 *
+	 *                Rectangles are given in buffer coordinates as consecutive x, y, width, height int32 values. The pixels
+	 *                of all rectangles are packed one after the other, in the order of the rectangles, each rectangle row by
+	 *                row without padding. The pixel format is RGBA8888, same as with attach.
+	 *
+	 *                Ownership of the array buffer is passed to the compositor, which returns it with a detach event once
+	 *                the pixels have been copied.
+	 *            
+	 *
+	 * @param resource The protocol resource of this implementation.
+	 * @param contents An HTML5 array buffer with the packed pixels of all rectangles. 
+	 * @param rectangles The damaged rectangles as x, y, width, height int32 values. 
+	 *
+	 * @since 2
+	 *
+	 */
+	attachDamaged(resource: GrWebShmBufferResource, contents: WebFD, rectangles: ArrayBuffer): void
 }
 
 
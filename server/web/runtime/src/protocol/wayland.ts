@@ -2643,7 +2643,7 @@ export class WlPointerResource extends Westfield.Resource {
 	 *
 	 */
 	motion (time: number, surfaceX: Fixed, surfaceY: Fixed) {
-		this.client.marshall(this.id, 2, [uint(time), fixed(surfaceX), fixed(surfaceY)])
+		this.client.marshall(this.id, 2, [uint(time), fixed(surfaceX), fixed(surfaceY)], true)
 	}
 
 	/**
@@ -2748,7 +2748,7 @@ export class WlPointerResource extends Westfield.Resource {
 	 *
 	 */
 	frame () {
-		this.client.marshall(this.id, 5, [])
+		this.client.marshall(this.id, 5, [], true)
 	}
 
 	/**
@@ -4,16 +4,18 @@ import {
   n,
   object,
   s,
+  SERVER_OBJECT_ID_BASE,
+  SharedRing,
+  SharedRingFrame,
   string,
   u,
   uint,
+  WebFD,
   WlMessage,
   WlObject
 } from 'westfield-runtime-common'
 
 
-const SERVER_OBJECT_ID_BASE = 0xff000000
-
 /**
  * Represents a client connection.
  */
@@ -21,6 +23,9 @@ export class Client implements DisplayRequests {
   readonly id: string
   readonly connection: Connection
   readonly displayResource: DisplayResource
+  /**
+   * Free list of server allocated ids, used as a stack so taking and returning an id is O(1).
+   */
   recycledIds: number[] = []
   private _display: Display
   private _syncEventSerial: number = 0
@@ -34,6 +39,10 @@ export class Client implements DisplayRequests {
    * in the range [0xff000000, 0xffffffff]. The 0 ID is reserved to represent a null or non-existent object
    */
   private _nextId: number = SERVER_OBJECT_ID_BASE
+  private _transportBufferedAmount?: () => number
+  private _rings?: { in: SharedRing, out: SharedRing }
+  // fds that arrived over the side channel but whose ring frame was not yet processed
+  private _ringFds: WebFD[] = []
 
   constructor(display: Display, id: string) {
     this.id = id
@@ -50,7 +59,7 @@ export class Client implements DisplayRequests {
     this.connection.close()
 
     // destroy resources in descending order
-    Object.values(this.connection.wlObjects).sort((a, b) => a.id - b.id).forEach((resource) => resource.destroy())
+    this.connection.wlObjects.values().forEach((resource) => resource.destroy())
     this._destroyedResolver()
   }
 
@@ -58,6 +67,97 @@ export class Client implements DisplayRequests {
     return this._destroyPromise
   }
 
+  /**
+   * Enables backpressure on the connection of this client. Events are held back while the transport has more than
+   * highWaterMark flushed bytes that it did not send yet, and obsoletable events like pointer motion are coalesced
+   * meanwhile.
+   *
+   * @param bufferedAmount The number of bytes the transport did not send yet, eg. WebSocket.bufferedAmount or
+   * RTCDataChannel.bufferedAmount.
+   * @param highWaterMark
+   */
+  setTransportBufferedAmount(bufferedAmount: () => number, highWaterMark: number) {
+    this._transportBufferedAmount = bufferedAmount
+    this.connection.highWaterMark = highWaterMark
+    this.updateBytesInFlight()
+  }
+
+  /**
+   * Releases the bytes the transport sent since the last call, flushing held back events if it drained enough. Called
+   * by Display.flushClients. Transports that signal when they drain, like RTCDataChannel.onbufferedamountlow, can call
+   * it from there as well.
+   */
+  updateBytesInFlight() {
+    if (this._transportBufferedAmount === undefined) {
+      return
+    }
+    const sent = this.connection.bytesInFlight - this._transportBufferedAmount()
+    if (sent > 0) {
+      this.connection.releaseBytesInFlight(sent)
+    }
+  }
+
+  /**
+   * Moves the requests of a web worker client onto a shared memory ring, see SharedRing. The returned buffers are
+   * posted to the client as `{ rings }`. From then on its requests are read from the clientToServer ring, and its
+   * `{ meta }` messages only carry the fds of those requests, which must be handed to receiveRingFds. Flushes that do
+   * not fit the ring still arrive as `{ protocolMessage, meta }` and are passed to connection.message as before.
+   *
+   * Events may keep going to the client over postMessage. The serverToClient ring is read by the client, an embedder
+   * that wants to write its events there too can do so through the ring returned by outRing.
+   *
+   * Requires Atomics.waitAsync.
+   *
+   * @param byteCapacity Size of each ring, see SharedRing.create.
+   */
+  createSharedRings(byteCapacity: number): { serverToClient: SharedArrayBuffer, clientToServer: SharedArrayBuffer } {
+    if (this._rings) {
+      throw new Error('Client already uses shared rings.')
+    }
+    const rings = { in: SharedRing.create(byteCapacity), out: SharedRing.create(byteCapacity) }
+    this._rings = rings
+    this._pollRing(rings.in)
+    return { serverToClient: rings.out.sharedBuffer, clientToServer: rings.in.sharedBuffer }
+  }
+
+  get outRing(): SharedRing | undefined {
+    return this._rings?.out
+  }
+
+  /**
+   * Hands over the fds of a `{ meta }` message of a client that uses shared rings. Ring frames are held back until all
+   * of their fds have arrived.
+   */
+  receiveRingFds(fds: WebFD[]) {
+    if (this._rings === undefined) {
+      throw new Error('Client does not use shared rings.')
+    }
+    this._ringFds = [...this._ringFds, ...fds]
+    this._receiveFromRing(this._rings.in)
+  }
+
+  private _receiveFromRing(ring: SharedRing) {
+    // a frame is only processed once all of its fds have arrived over the side channel
+    let fdCount = ring.peekFdCount()
+    while (fdCount !== undefined && fdCount <= this._ringFds.length && !this.connection.closed) {
+      const frame = ring.read() as SharedRingFrame
+      const fds = this._ringFds.slice(0, fdCount)
+      this._ringFds = this._ringFds.slice(fdCount)
+      this.connection.message({ buffer: frame.buffer, fds }).catch((e: Error) => {
+        console.error(`Failed to process requests from shared ring. client: ${this.id}, message: ${e.message}`)
+        this.close()
+      })
+      fdCount = ring.peekFdCount()
+    }
+  }
+
+  private async _pollRing(ring: SharedRing) {
+    while (!this.connection.closed) {
+      this._receiveFromRing(ring)
+      await ring.waitReadableAsync()
+    }
+  }
+
   registerResource(resource: Resource) {
     this.connection.registerWlObject(resource)
   }
@@ -113,11 +213,18 @@ export class Client implements DisplayRequests {
     return serverSideId
   }
 
-  marshall(id: number, opcode: number, argsArray: MessageMarshallingContext<any, any, any>[]) {
+  /**
+   * @param id
+   * @param opcode
+   * @param argsArray
+   * @param obsoletable If a newer event with the same id and opcode may replace this one while the connection is
+   * congested.
+   */
+  marshall(id: number, opcode: number, argsArray: MessageMarshallingContext<any, any, any>[], obsoletable: boolean = false) {
     // determine required wire message length
     let size = 4 + 2 + 2  // id+size+opcode
     argsArray.forEach(arg => size += arg.size)
-    this.connection.marshallMsg(id, opcode, size, argsArray)
+    this.connection.marshallMsg(id, opcode, size, argsArray, obsoletable)
   }
 
   sync(resource: DisplayResource, id: number) {
@@ -132,13 +239,48 @@ export class Client implements DisplayRequests {
 
   getNextId() {
     if (this.recycledIds.length) {
-      return this.recycledIds.shift()!
+      return this.recycledIds.pop()!
     } else {
       return this._nextId++
     }
   }
 }
 
+/**
+ * Copies the packed pixels received with gr_web_shm_buffer.attach_damaged into the retained pixels of the complete
+ * buffer. Only the damaged rectangles are touched.
+ *
+ * @param pixels The retained RGBA8888 pixels of the complete buffer.
+ * @param width The buffer width in pixels.
+ * @param rectangles The damaged rectangles as x, y, width, height int32 values.
+ * @param packedPixels The pixels of all rectangles, one after the other, row by row.
+ */
+export function patchDamagedPixels(pixels: ArrayBuffer, width: number, rectangles: ArrayBuffer, packedPixels: ArrayBuffer) {
+  // one RGBA8888 pixel fits exactly in one uint32
+  const destination = new Uint32Array(pixels)
+  const source = new Uint32Array(packedPixels)
+  const rects = new Int32Array(rectangles, 0, rectangles.byteLength >> 2)
+  const height = destination.length / width
+
+  let offset = 0
+  for (let i = 0; i + 3 < rects.length; i += 4) {
+    const x = rects[i]
+    const y = rects[i + 1]
+    const rectWidth = rects[i + 2]
+    const rectHeight = rects[i + 3]
+    if (x < 0 || y < 0 || rectWidth < 0 || rectHeight < 0 || x + rectWidth > width || y + rectHeight > height) {
+      throw new Error(`Damaged rectangle ${x},${y} ${rectWidth}x${rectHeight} exceeds buffer bounds.`)
+    }
+    if (offset + (rectWidth * rectHeight) > source.length) {
+      throw new Error(`Packed pixels too short for damaged rectangles.`)
+    }
+    for (let row = y; row < y + rectHeight; row++) {
+      destination.set(source.subarray(offset, offset + rectWidth), (row * width) + x)
+      offset += rectWidth
+    }
+  }
+}
+
 export class Resource extends WlObject {
   readonly client: Client
   readonly version: number
@@ -190,7 +332,10 @@ export class Display {
   }
 
   flushClients() {
-    Object.values(this.clients).forEach(client => client.connection.flush())
+    Object.values(this.clients).forEach(client => {
+      client.updateBytesInFlight()
+      client.connection.flush()
+    })
   }
 }
 
@@ -0,0 +1,85 @@
+import { Fixed, SendMessage, SharedRing, WebFD } from 'westfield-runtime-common'
+import { Client, Display, WlPointerResource } from '../src'
+
+describe('Client', () => {
+  it('coalesces pointer motion while its transport is backed up', () => {
+    // given
+    const client = new Client(new Display(), 'test')
+    const flushed: SendMessage[] = []
+    let bufferedAmount = 0
+    client.connection.onFlush = (messages) => {
+      flushed.push(...messages)
+      bufferedAmount += messages.reduce((size, message) => size + message.buffer.byteLength, 0)
+    }
+    client.setTransportBufferedAmount(() => bufferedAmount, 64)
+    const pointer = new WlPointerResource(client, 2, 7)
+    // fill up the transport
+    for (let x = 0; x < 4; x++) {
+      pointer.motion(x, Fixed.parse(x), Fixed.parse(0))
+      pointer.frame()
+      client.connection.flush()
+    }
+    expect(client.connection.writable).toBe(false)
+    flushed.length = 0
+
+    // when
+    for (let x = 4; x < 100; x++) {
+      pointer.motion(x, Fixed.parse(x), Fixed.parse(0))
+      pointer.frame()
+      client.connection.flush()
+    }
+    bufferedAmount = 0
+    client.updateBytesInFlight()
+
+    // then
+    expect(flushed.map(message => message.opcode)).toEqual([2, 5])
+    expect(new Uint32Array(flushed[0].buffer)[2]).toBe(99)
+  })
+
+  it('does not hold back events without a high water mark', () => {
+    // given
+    const client = new Client(new Display(), 'test')
+    const flushed: SendMessage[] = []
+    client.connection.onFlush = (messages) => flushed.push(...messages)
+    const pointer = new WlPointerResource(client, 2, 7)
+
+    // when
+    for (let x = 0; x < 10; x++) {
+      pointer.motion(x, Fixed.parse(x), Fixed.parse(0))
+      pointer.frame()
+      client.connection.flush()
+    }
+
+    // then
+    expect(flushed).toHaveLength(20)
+  })
+})
+
+describe('Client shared rings', () => {
+  it('processes ring frames once their fds have arrived', async () => {
+    // given
+    const client = new Client(new Display(), 'test')
+    const flushed: SendMessage[] = []
+    client.connection.onFlush = (messages) => flushed.push(...messages)
+    const rings = client.createSharedRings(1024)
+    const clientToServer = new SharedRing(rings.clientToServer)
+    // wl_display.sync with a new callback id, as the client would write it
+    const sync = new Uint32Array([1, (12 << 16) | 0, 2])
+
+    // when
+    clientToServer.write([{ buffer: sync.buffer }], 1)
+    await new Promise(resolve => setTimeout(resolve, 10))
+
+    // then
+    expect(flushed).toHaveLength(0)
+
+    // when
+    client.receiveRingFds([new WebFD(3, 'ArrayBuffer', () => new URL('test://fd/3'), () => new ArrayBuffer(0), () => {})])
+    await new Promise(resolve => setTimeout(resolve, 10))
+
+    // then
+    expect(flushed.map(message => message.opcode)).toEqual([0, 1])
+    expect(clientToServer.peekFdCount()).toBeUndefined()
+    client.close()
+  })
+})